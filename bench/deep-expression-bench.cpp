@@ -0,0 +1,157 @@
+/* The front end and code generation of expressions nested 10^5 levels
+   deep, from the tree and from the flat AST, and a check that both emit
+   the same module.
+
+   usage: deep-expression-bench [depth]
+
+   Two sources are written to tmp/: one whose function returns
+   x + 1 + x + 2 + ..., where each operator is the left operand of the
+   next, and one returning inc(inc(...inc(x))). Each is parsed with the
+   bison grammar, run through the AST passes and flattened, and each of
+   those steps is timed along with code generation. The descent parser
+   recurses once per nested call, so it is left out. The tree's trace on
+   stderr is sent to /dev/null but still formatted. */
+#include <cstdio>
+#include <cstdlib>
+#include <sys/time.h>
+#include <llvm/Support/raw_ostream.h>
+#include "src/includes/codegen.hpp"
+#include "src/includes/flat-ast.hpp"
+#include "src/includes/parser-state.hpp"
+#include "src/includes/ast-pass.hpp"
+#include "src/includes/const-fold.hpp"
+#include "src/includes/type-inference.hpp"
+
+void createCoreFunctions(CodeGenContext& context);
+
+static double now() {
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+enum Shape { SHAPE_OPERATORS, SHAPE_CALLS };
+
+static const char *generate(const char *fileName, Shape shape, unsigned depth) {
+  FILE *f = fopen(fileName, "w");
+  if (f == NULL) {
+    perror(fileName);
+    exit(1);
+  }
+  fprintf(f, "module deep_bench\n\n"
+      "function inc = |n| {\n"
+      "  return n + 1\n"
+      "}\n\n"
+      "function deep = |x| {\n"
+      "  return ");
+  if (shape == SHAPE_OPERATORS) {
+    fprintf(f, "x");
+    for (unsigned i = 0; i < depth; i++) {
+      if (i % 2 == 0) {
+        fprintf(f, " + %u", i + 1);
+      } else {
+        fprintf(f, " + x");
+      }
+    }
+  } else {
+    for (unsigned i = 0; i < depth; i++) {
+      fputs("inc(", f);
+    }
+    fputc('x', f);
+    for (unsigned i = 0; i < depth; i++) {
+      fputc(')', f);
+    }
+  }
+  fprintf(f, "\n}\n\n"
+      "function main = |args| {\n"
+      "  println(deep(1))\n"
+      "  return 0\n"
+      "}\n");
+  fclose(f);
+  return fileName;
+}
+
+static std::string print(Module *module) {
+  std::string text;
+  raw_string_ostream os(text);
+  module->print(os, 0);
+  os.flush();
+  return text;
+}
+
+/* Generates code from the tree, or from the flat AST when given one */
+static double codeGen(ParserState& state, const FlatAst *flat, std::string *text) {
+  CodeGenContext context("deep_bench", state.symbols);
+  createCoreFunctions(context);
+  double start = now();
+  if (flat != NULL) {
+    context.generateCode(*flat);
+  } else {
+    context.generateCode(*state.topLevelModule, *state.programBlock);
+  }
+  double seconds = now() - start;
+  if (text != NULL) {
+    *text = print(context.module);
+  }
+  return seconds;
+}
+
+int main(int argc, char **argv) {
+  unsigned depth = argc > 1 ? atoi(argv[1]) : 100000;
+  printf("depth %u\n", depth);
+
+  freopen("/dev/null", "w", stderr);
+
+  const char *shapes[] = { "operators", "calls" };
+  const char *files[] = { "tmp/deep-operators.golo", "tmp/deep-calls.golo" };
+  const char *names[] = { "tree", "flat" };
+  for (int s = 0; s < 2; s++) {
+    SourceBuffer source;
+    const char *fileName = generate(files[s], (Shape)s, depth);
+    if (!source.open(fileName)) {
+      perror(fileName);
+      return 1;
+    }
+
+    ParserState state;
+    double start = now();
+    if (!parseSource(source, state)) {
+      printf("%s\n", state.error.c_str());
+      return 1;
+    }
+    double parsing = now() - start;
+
+    AstPassManager passes;
+    passes.add(new ConstantFolder());
+    passes.add(new TypeInference());
+    start = now();
+    passes.run(*state.programBlock, state.arena);
+    double passing = now() - start;
+
+    start = now();
+    FlatAst flat;
+    flat.build(*state.topLevelModule, *state.programBlock);
+    double flattening = now() - start;
+
+    printf("%-9s %8.3f s parse, %8.3f s AST passes, %8.3f s flatten\n", shapes[s], parsing, passing, flattening);
+
+    const FlatAst *asts[] = { NULL, &flat };
+    std::string modules[2];
+    for (int k = 0; k < 2; k++) {
+      double best = 0;
+      for (int run = 0; run < 3; run++) {
+        double seconds = codeGen(state, asts[k], run == 0 ? &modules[k] : NULL);
+        if (run == 0 || seconds < best) {
+          best = seconds;
+        }
+      }
+      printf("%-9s %-4s %8.3f s codegen\n", shapes[s], names[k], best);
+    }
+    if (modules[0] != modules[1]) {
+      printf("%s: modules differ\n", shapes[s]);
+      return 1;
+    }
+  }
+  printf("Modules are identical\n");
+  return 0;
+}
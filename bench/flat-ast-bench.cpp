@@ -0,0 +1,130 @@
+/* AST memory and code generation time of the tree built by the parser
+   against its flat copy, and a check that both emit the same module.
+
+   usage: flat-ast-bench [source.golo]
+
+   Without a source file, a synthetic module of about 8 MiB is written
+   to tmp/flat-ast-bench.golo and used instead. The tree's codeGen
+   methods print a trace on stderr, which is sent to /dev/null here but
+   still formatted: its cost is part of the tree's time. */
+#include <cstdio>
+#include <cstdlib>
+#include <sys/time.h>
+#include <llvm/Support/raw_ostream.h>
+#include "src/includes/codegen.hpp"
+#include "src/includes/flat-ast.hpp"
+#include "src/includes/parser-state.hpp"
+
+void createCoreFunctions(CodeGenContext& context);
+
+static double now() {
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+/* Functions only call the ones before them, which codegen requires */
+static const char *generate(const char *fileName, size_t size) {
+  FILE *f = fopen(fileName, "w");
+  if (f == NULL) {
+    perror(fileName);
+    exit(1);
+  }
+  fprintf(f, "module flat_bench\n\n"
+      "function compute_0 = |alpha, beta, gamma| {\n"
+      "  return alpha + beta * gamma\n"
+      "}\n\n");
+  unsigned i;
+  for (i = 1; (size_t)ftell(f) < size; i++) {
+    fprintf(f,
+        "# generated function number %u\n"
+        "function compute_%u = |alpha, beta, gamma| {\n"
+        "  let scaled = alpha * %u + beta / 2 - gamma * (alpha - 1)\n"
+        "  scaled = compute_%u(scaled, gamma - beta, %u)\n"
+        "  return scaled * 3 + compute_%u(alpha, beta, gamma) / (beta + 1)\n"
+        "}\n\n", i, i, i % 1000, i - 1, i * 7, i - 1);
+  }
+  fprintf(f,
+      "function main = |args| {\n"
+      "  println(compute_%u(1, 2, 3))\n"
+      "  return 0\n"
+      "}\n", i - 1);
+  fclose(f);
+  return fileName;
+}
+
+static std::string print(Module *module) {
+  std::string text;
+  raw_string_ostream os(text);
+  module->print(os, 0);
+  os.flush();
+  return text;
+}
+
+/* Generates code from the tree, or from the flat AST when given one */
+static double codeGen(ParserState& state, const FlatAst *flat, std::string *text) {
+  CodeGenContext context("flat_bench", state.symbols);
+  createCoreFunctions(context);
+  double start = now();
+  if (flat != NULL) {
+    context.generateCode(*flat);
+  } else {
+    context.generateCode(*state.topLevelModule, *state.programBlock);
+  }
+  double seconds = now() - start;
+  if (text != NULL) {
+    *text = print(context.module);
+  }
+  return seconds;
+}
+
+int main(int argc, char **argv) {
+  const char *fileName = argc > 1 ? argv[1] : generate("tmp/flat-ast-bench.golo", 8 << 20);
+
+  SourceBuffer source;
+  if (!source.open(fileName)) {
+    perror(fileName);
+    return 1;
+  }
+  printf("%s: %.1f MiB\n", fileName, source.size() / (1024.0 * 1024.0));
+
+  ParserState state;
+  ParseOptions options;
+  options.parser = PARSER_DESCENT;
+  if (!parseSource(source, state, options)) {
+    fprintf(stderr, "%s\n", state.error.c_str());
+    return 1;
+  }
+
+  double start = now();
+  FlatAst flat;
+  flat.build(*state.topLevelModule, *state.programBlock);
+  double flattening = now() - start;
+
+  printf("tree     %10lu bytes\n", (unsigned long)state.arena.bytesAllocated());
+  printf("flat     %10lu bytes  (%lu nodes, built in %.3f s)\n",
+      (unsigned long)flat.bytesUsed(), (unsigned long)flat.nodes.size(), flattening);
+
+  freopen("/dev/null", "w", stderr);
+
+  const char *names[] = { "tree", "flat" };
+  const FlatAst *asts[] = { NULL, &flat };
+  std::string modules[2];
+  for (int k = 0; k < 2; k++) {
+    double best = 0;
+    for (int run = 0; run < 3; run++) {
+      double seconds = codeGen(state, asts[k], run == 0 ? &modules[k] : NULL);
+      if (run == 0 || seconds < best) {
+        best = seconds;
+      }
+    }
+    printf("%-8s %8.3f s codegen\n", names[k], best);
+  }
+
+  if (modules[0] != modules[1]) {
+    printf("Modules differ\n");
+    return 1;
+  }
+  printf("Modules are identical\n");
+  return 0;
+}
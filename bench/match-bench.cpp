@@ -0,0 +1,106 @@
+/* Cost of one dispatch through a match as its number of arms grows,
+   for each way a match is lowered:
+
+     switch  when x == 0 then ..., when x == 1 then ...: a switch, which
+             the backend turns into a jump table
+     tree    the same on floating point keys 0.0, 1.0, ...: a balanced
+             decision tree
+     chain   when x < 1 then ..., when x < 2 then ...: conditions that
+             are not keys, tested one after the other
+
+   usage: match-bench [calls]
+
+   Each match is the body of pick = |x: i64|: i64, built directly rather
+   than parsed, generated at -O2 and run through the JIT on the same
+   random arguments, one in 64 of which falls through to the otherwise. */
+#include <cstdio>
+#include <cstdlib>
+#include <sys/time.h>
+#include "src/includes/codegen.hpp"
+#include "build/parser.hpp"
+
+static double now() {
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+enum Shape { SHAPE_SWITCH, SHAPE_TREE, SHAPE_CHAIN };
+
+typedef long long (*Pick)(long long);
+
+/* Arm i is 7 * i + 3, the otherwise -1 */
+static Function *buildPick(CodeGenContext& context, Arena& arena, SymbolTable& symbols, Shape shape, unsigned arms) {
+  const Symbol *x = symbols.intern("x");
+  NMatch *match = new (arena) NMatch(arena, false);
+  for (unsigned i = 0; i < arms; i++) {
+    NExpression *key;
+    if (shape == SHAPE_TREE) {
+      key = new (arena) NDouble(i);
+    } else {
+      key = new (arena) NInteger(shape == SHAPE_CHAIN ? i + 1 : i);
+    }
+    NBinaryOperator *condition = new (arena) NBinaryOperator(*new (arena) NIdentifier(x),
+                                                             shape == SHAPE_CHAIN ? TCLT : TCEQ, *key);
+    condition->type = TYPE_BOOL;
+    match->conditions.push_back(condition);
+    match->arms.push_back(new (arena) NInteger(7 * i + 3));
+  }
+  match->otherwise = new (arena) NInteger(-1);
+  match->type = TYPE_INT;
+
+  std::vector<const Symbol*> arguments(1, x);
+  std::vector<ValueType> argumentTypes(1, TYPE_INT);
+  Function *function = context.beginFunction(symbols.intern("pick"), arguments, argumentTypes, TYPE_INT, true);
+  /* called from C below, not from Golo */
+  function->setCallingConv(CallingConv::C);
+  context.createReturn(match->codeGen(context, 0));
+  context.endFunction();
+  context.optimizeFunction(*function);
+  return function;
+}
+
+int main(int argc, char **argv) {
+  unsigned calls = argc > 1 ? atoi(argv[1]) : 20000000;
+  InitializeNativeTarget();
+  freopen("/dev/null", "w", stderr);
+
+  const char *names[] = { "switch", "tree", "chain" };
+  const unsigned arms[] = { 4, 16, 64, 256, 1024 };
+  std::vector<long long> inputs(4096);
+  for (unsigned s = 0; s < 3; s++) {
+    for (unsigned a = 0; a < sizeof(arms) / sizeof(arms[0]); a++) {
+      srand(a);
+      for (size_t i = 0; i < inputs.size(); i++) {
+        inputs[i] = rand() % 64 == 0 ? arms[a] : rand() % arms[a];
+      }
+
+      SymbolTable symbols;
+      Arena arena;
+      CodeGenOptions options;
+      options.optLevel = 2;
+      CodeGenContext context("match_bench", symbols, options);
+      Function *function = buildPick(context, arena, symbols, (Shape)s, arms[a]);
+      ExecutionEngine *engine = EngineBuilder(context.module).setOptLevel(CodeGenOpt::Default).create();
+      Pick pick = (Pick)(intptr_t)engine->getPointerToFunction(function);
+
+      for (unsigned k = 0; k <= arms[a]; k++) {
+        if (pick(k) != (k < arms[a] ? 7 * (long long)k + 3 : -1)) {
+          printf("%s, %u arms: wrong arm for %u\n", names[s], arms[a], k);
+          return 1;
+        }
+      }
+      long long sum = 0;
+      double start = now();
+      for (unsigned i = 0; i < calls; i++) {
+        sum += pick(inputs[i % inputs.size()]);
+      }
+      double seconds = now() - start;
+      printf("%-6s %5u arms %8.2f ns/dispatch  (%lld)\n", names[s], arms[a], seconds * 1e9 / calls, sum);
+      /* the context deletes the module */
+      engine->removeModule(context.module);
+      delete engine;
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,254 @@
+/* Parse time of the bison grammar against the hand-written descent
+   parser, each with the lexer on the parser's thread and on its own,
+   and of loading the same AST from its cache; and a check that they
+   all build the same AST.
+
+   usage: parser-bench [source.golo]
+
+   Without a source file, a synthetic module of about 32 MiB is written
+   to tmp/parser-bench.golo and used instead. */
+#include <cstdio>
+#include <cstdlib>
+#include <sys/time.h>
+#include <typeinfo>
+#include "src/includes/lexer.hpp"
+#include "src/includes/parser-state.hpp"
+#include "src/includes/ast-cache.hpp"
+
+static double now() {
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+static const char *generate(const char *fileName, size_t size) {
+  FILE *f = fopen(fileName, "w");
+  if (f == NULL) {
+    perror(fileName);
+    exit(1);
+  }
+  fprintf(f, "module parser_bench\n\n");
+  for (unsigned i = 0; (size_t)ftell(f) < size; i++) {
+    fprintf(f,
+        "# generated function number %u\n"
+        "function compute_%u = |alpha, beta, gamma| {\n"
+        "  let scaled = alpha * %u + beta / 2 - gamma * (alpha - 1)\n"
+        "  let flag = scaled + 1 < gamma * 2\n"
+        "  scaled = compute_%u(scaled, gamma - beta, %u, flag)\n"
+        "  for (let i = 0, i < gamma, i = i + 1) {\n"
+        "    if i < 2 { scaled = scaled + i } else if i == 3 { scaled = scaled - 1 }\n"
+        "    else { while scaled > 100 { scaled = scaled / 2 } }\n"
+        "  }\n"
+        "  case {\n"
+        "    when alpha == 1 { scaled = scaled + 1 }\n"
+        "    when alpha == 2 { scaled = scaled - 1 }\n"
+        "    otherwise { scaled = 0 }\n"
+        "  }\n"
+        "  foreach k in range(0, gamma, 2) { scaled = scaled + k }\n"
+        "  let pick = match { when beta == 0 then 1 when beta == 1.5 then 2 otherwise gamma }\n"
+        "  return scaled * 3 + compute_%u(alpha, beta, gamma) / (beta + 1)\n"
+        "}\n\n", i, i, i % 1000, i + 1, i * 7, i);
+  }
+  fclose(f);
+  return fileName;
+}
+
+/* Writes the tree out in prefix form so two ASTs compare as strings */
+static void dump(Node *node, std::string& out) {
+  char number[64];
+  out += typeid(*node).name();
+  out += '(';
+  if (NIdentifier *ident = dynamic_cast<NIdentifier*>(node)) {
+    out += ident->name.str();
+  } else if (NInteger *integer = dynamic_cast<NInteger*>(node)) {
+    snprintf(number, sizeof(number), "%lld", integer->value);
+    out += number;
+  } else if (NDouble *real = dynamic_cast<NDouble*>(node)) {
+    snprintf(number, sizeof(number), "%.17g", real->value);
+    out += number;
+  } else if (NString *string = dynamic_cast<NString*>(node)) {
+    out += string->value.str();
+  } else if (NMethodCall *call = dynamic_cast<NMethodCall*>(node)) {
+    out += call->id.name.str();
+    for (ExpressionList::iterator it = call->arguments.begin(); it != call->arguments.end(); it++) {
+      dump(*it, out);
+    }
+  } else if (NBinaryOperator *binary = dynamic_cast<NBinaryOperator*>(node)) {
+    snprintf(number, sizeof(number), "%d", binary->op);
+    out += number;
+    dump(binary->lhs, out);
+    dump(binary->rhs, out);
+  } else if (NAssignment *assignment = dynamic_cast<NAssignment*>(node)) {
+    dump(&assignment->lhs, out);
+    dump(assignment->rhs, out);
+  } else if (NBlock *block = dynamic_cast<NBlock*>(node)) {
+    for (StatementList::iterator it = block->statements.begin(); it != block->statements.end(); it++) {
+      dump(*it, out);
+    }
+  } else if (NExpressionStatement *statement = dynamic_cast<NExpressionStatement*>(node)) {
+    dump(statement->expression, out);
+  } else if (NReturnStatement *statement = dynamic_cast<NReturnStatement*>(node)) {
+    dump(statement->expression, out);
+  } else if (NCommentStatement *comment = dynamic_cast<NCommentStatement*>(node)) {
+    out += comment->comment.str();
+  } else if (NVariableDeclaration *declaration = dynamic_cast<NVariableDeclaration*>(node)) {
+    dump(&declaration->id, out);
+    if (declaration->assignmentExpr != NULL) {
+      dump(declaration->assignmentExpr, out);
+    }
+  } else if (NFunctionDeclaration *function = dynamic_cast<NFunctionDeclaration*>(node)) {
+    out += function->externalLinkage ? "external " : "internal ";
+    out += function->id.name.str();
+    for (VariableList::iterator it = function->arguments.begin(); it != function->arguments.end(); it++) {
+      dump(*it, out);
+    }
+    dump(&function->block, out);
+  } else if (NIfStatement *statement = dynamic_cast<NIfStatement*>(node)) {
+    dump(statement->condition, out);
+    dump(&statement->thenBlock, out);
+    if (statement->elseBlock != NULL) {
+      dump(statement->elseBlock, out);
+    }
+  } else if (NWhileStatement *statement = dynamic_cast<NWhileStatement*>(node)) {
+    dump(statement->condition, out);
+    dump(&statement->block, out);
+  } else if (NForStatement *statement = dynamic_cast<NForStatement*>(node)) {
+    dump(&statement->initializer, out);
+    dump(statement->condition, out);
+    dump(statement->step, out);
+    dump(&statement->block, out);
+  } else if (NForeachStatement *statement = dynamic_cast<NForeachStatement*>(node)) {
+    dump(&statement->id, out);
+    dump(statement->from, out);
+    dump(statement->to, out);
+    if (statement->step != NULL) {
+      dump(statement->step, out);
+    }
+    dump(&statement->block, out);
+  } else if (NMatch *match = dynamic_cast<NMatch*>(node)) {
+    out += match->isCase ? "case" : "match";
+    for (size_t i = 0; i < match->conditions.size(); i++) {
+      dump(match->conditions[i], out);
+      dump(match->arms[i], out);
+    }
+    if (match->otherwise != NULL) {
+      dump(match->otherwise, out);
+    }
+  } else if (NModule *module = dynamic_cast<NModule*>(node)) {
+    out += module->ident.name.str();
+  }
+  out += ')';
+}
+
+/* Writes the cache once, then times loading it */
+static bool load(const char *fileName, std::string *tree, double *seconds) {
+  SourceBuffer source;
+  if (!source.open(fileName)) {
+    perror(fileName);
+    exit(1);
+  }
+  std::string cachePath = astCachePath(fileName);
+  if (tree == NULL) {
+    ParserState state;
+    if (!parseSource(source, state) || !writeAstCache(cachePath.c_str(), source, state)) {
+      fprintf(stderr, "unable to write %s\n", cachePath.c_str());
+      return false;
+    }
+  }
+  ParserState state;
+  double start = now();
+  bool loaded = loadAstCache(cachePath.c_str(), source, state);
+  *seconds = now() - start;
+  if (!loaded) {
+    fprintf(stderr, "unable to load %s\n", cachePath.c_str());
+    return false;
+  }
+  if (tree != NULL) {
+    dump(state.topLevelModule, *tree);
+    dump(state.programBlock, *tree);
+  }
+  return true;
+}
+
+static bool parse(const ParseOptions& options, const char *fileName, std::string *tree, double *seconds) {
+  SourceBuffer source;
+  if (!source.open(fileName)) {
+    perror(fileName);
+    exit(1);
+  }
+  ParserState state;
+
+  double start = now();
+  bool parsed = parseSource(source, state, options);
+  *seconds = now() - start;
+  if (!parsed) {
+    fprintf(stderr, "%s\n", state.error.c_str());
+    return false;
+  }
+  if (tree != NULL) {
+    dump(state.topLevelModule, *tree);
+    dump(state.programBlock, *tree);
+  }
+  return true;
+}
+
+int main(int argc, char **argv) {
+  const char *fileName = argc > 1 ? argv[1] : generate("tmp/parser-bench.golo", 32 << 20);
+
+  SourceBuffer source;
+  if (!source.open(fileName)) {
+    perror(fileName);
+    return 1;
+  }
+  double megabytes = source.size() / (1024.0 * 1024.0);
+  printf("%s: %.1f MiB\n", fileName, megabytes);
+
+  const char *names[] = { "bison", "descent", "bison, pipelined", "descent, pipelined" };
+  ParseOptions options[4];
+  for (int k = 0; k < 4; k++) {
+    options[k].parser = k % 2 ? PARSER_DESCENT : PARSER_BISON;
+    options[k].pipelineThreshold = k < 2 ? (size_t)-1 : 0;
+  }
+  std::string trees[4];
+  for (int k = 0; k < 4; k++) {
+    double best = 0;
+    for (int run = 0; run < 5; run++) {
+      double seconds;
+      if (!parse(options[k], fileName, NULL, &seconds)) {
+        return 1;
+      }
+      if (run == 0 || seconds < best) {
+        best = seconds;
+      }
+    }
+    printf("%-20s %8.3f s  %8.1f MiB/s\n", names[k], best, megabytes / best);
+  }
+  double cached = 0;
+  for (int run = 0; run < 5; run++) {
+    double seconds;
+    if (!load(fileName, NULL, &seconds)) {
+      return 1;
+    }
+    if (run == 0 || seconds < cached) {
+      cached = seconds;
+    }
+  }
+  printf("%-20s %8.3f s  %8.1f MiB/s\n", "AST cache", cached, megabytes / cached);
+
+  for (int k = 0; k < 4; k++) {
+    double seconds;
+    parse(options[k], fileName, &trees[k], &seconds);
+    if (trees[k] != trees[0]) {
+      printf("ASTs differ\n");
+      return 1;
+    }
+  }
+  std::string cachedTree;
+  double seconds;
+  if (!load(fileName, &cachedTree, &seconds) || cachedTree != trees[0]) {
+    printf("ASTs differ\n");
+    return 1;
+  }
+  printf("ASTs are identical\n");
+  return 0;
+}
@@ -0,0 +1,96 @@
+/* Peak memory of build/goloc-llvm compiling whole programs against
+   streaming them one function at a time (-s), for growing inputs.
+
+   usage: streaming-bench
+
+   Synthetic modules of 1 to 8 MiB are written to tmp/ and compiled
+   with the output sent to /dev/null. Each compilation runs in a child
+   process so that its peak RSS can be read on its own. */
+#include <cstdio>
+#include <cstdlib>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+
+static const char *COMPILER = "build/goloc-llvm";
+
+static double now() {
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+/* Functions only call the ones before them, which codegen requires */
+static void generate(const char *fileName, size_t size) {
+  FILE *f = fopen(fileName, "w");
+  if (f == NULL) {
+    perror(fileName);
+    exit(1);
+  }
+  fprintf(f, "module streaming_bench\n\n"
+      "function compute_0 = |alpha, beta, gamma| {\n"
+      "  return alpha + beta * gamma\n"
+      "}\n\n");
+  unsigned i;
+  for (i = 1; (size_t)ftell(f) < size; i++) {
+    fprintf(f,
+        "# generated function number %u\n"
+        "function compute_%u = |alpha, beta, gamma| {\n"
+        "  let scaled = alpha * %u + beta / 2 - gamma * (alpha - 1)\n"
+        "  scaled = compute_%u(scaled, gamma - beta, %u)\n"
+        "  return scaled * 3 + compute_%u(alpha, beta, gamma) / (beta + 1)\n"
+        "}\n\n", i, i, i % 1000, i - 1, i * 7, i - 1);
+  }
+  fprintf(f,
+      "function main = |args| {\n"
+      "  println(compute_%u(1, 2, 3))\n"
+      "  return 0\n"
+      "}\n", i - 1);
+  fclose(f);
+}
+
+/* Returns the child's peak RSS in KiB, or -1 if it failed */
+static long compile(const char *fileName, bool streaming, double *seconds) {
+  double start = now();
+  pid_t pid = fork();
+  if (pid == 0) {
+    int null = open("/dev/null", O_WRONLY);
+    dup2(null, 1);
+    dup2(null, 2);
+    if (streaming) {
+      execl(COMPILER, COMPILER, "-N", "-s", "-c", fileName, "-o", "/dev/null", (char *)NULL);
+    } else {
+      execl(COMPILER, COMPILER, "-N", "-c", fileName, "-o", "/dev/null", (char *)NULL);
+    }
+    _exit(127);
+  }
+  int status;
+  struct rusage usage;
+  if (pid < 0 || wait4(pid, &status, 0, &usage) != pid || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+    return -1;
+  }
+  *seconds = now() - start;
+  return usage.ru_maxrss;
+}
+
+int main(int argc, char **argv) {
+  printf("%8s  %14s  %14s\n", "input", "whole program", "streaming");
+  for (int megabytes = 1; megabytes <= 8; megabytes *= 2) {
+    char fileName[64];
+    snprintf(fileName, sizeof(fileName), "tmp/streaming-bench-%d.golo", megabytes);
+    generate(fileName, (size_t)megabytes << 20);
+
+    double wholeTime, streamingTime;
+    long whole = compile(fileName, false, &wholeTime);
+    long streamed = compile(fileName, true, &streamingTime);
+    if (whole < 0 || streamed < 0) {
+      fprintf(stderr, "%s did not compile %s\n", COMPILER, fileName);
+      return 1;
+    }
+    printf("%5d MiB  %7ld KiB %4.1fs  %7ld KiB %4.1fs\n", megabytes,
+        whole, wholeTime, streamed, streamingTime);
+  }
+  return 0;
+}
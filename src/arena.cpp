@@ -0,0 +1,102 @@
+#include <cstdlib>
+#include <new>
+#include "src/includes/arena.hpp"
+
+/* Chunks are big enough that a multi-megabyte source only needs a few
+   hundred of them; anything larger than a chunk gets one of its own. */
+static const size_t CHUNK_SIZE = 256 * 1024;
+
+Arena::Arena() : current(NULL), end(NULL), last(NULL), spare(NULL), allocated(0), reserved(0), chunks(0) { }
+
+Arena::~Arena() {
+  reset();
+}
+
+void Arena::reset() {
+  while (last != NULL) {
+    Chunk *previous = last->previous;
+    free(last);
+    last = previous;
+  }
+  free(spare);
+  spare = NULL;
+  current = end = NULL;
+  allocated = reserved = 0;
+  chunks = 0;
+}
+
+Arena::Mark Arena::mark() const {
+  Mark mark;
+  mark.last = last;
+  mark.current = current;
+  mark.end = end;
+  mark.allocated = allocated;
+  return mark;
+}
+
+/* Chunks started since the mark go, all but one regular sized chunk
+   which stays as a spare: a parser rolling back after each function
+   would otherwise keep mapping and unmapping the same chunk. */
+void Arena::rollback(const Mark& mark) {
+  while (last != mark.last) {
+    Chunk *previous = last->previous;
+    reserved -= last->size;
+    chunks--;
+    if (spare == NULL && last->size == CHUNK_SIZE) {
+      spare = last;
+    } else {
+      free(last);
+    }
+    last = previous;
+  }
+  current = mark.current;
+  end = mark.end;
+  allocated = mark.allocated;
+}
+
+void *Arena::allocate(size_t size, size_t alignment) {
+  char *start = (char *)(((size_t)current + alignment - 1) & ~(alignment - 1));
+  if (current == NULL || start + size > end) {
+    return allocateSlow(size, alignment);
+  }
+  current = start + size;
+  allocated += size;
+  return start;
+}
+
+void *Arena::allocateSlow(size_t size, size_t alignment) {
+  size_t header = (sizeof(Chunk) + alignment - 1) & ~(alignment - 1);
+  size_t chunkSize = header + size > CHUNK_SIZE ? header + size : CHUNK_SIZE;
+
+  Chunk *chunk;
+  if (spare != NULL && chunkSize == CHUNK_SIZE) {
+    chunk = spare;
+    spare = NULL;
+  } else {
+    chunk = (Chunk *)malloc(chunkSize);
+    if (chunk == NULL) {
+      throw std::bad_alloc();
+    }
+  }
+  chunk->previous = last;
+  chunk->size = chunkSize;
+  last = chunk;
+  chunks++;
+  reserved += chunkSize;
+
+  char *start = (char *)chunk + header;
+  /* An oversized request does not replace the chunk being filled */
+  if (chunkSize == CHUNK_SIZE || current == NULL) {
+    current = start + size;
+    end = (char *)chunk + chunkSize;
+  }
+  allocated += size;
+  return start;
+}
+
+llvm::StringRef Arena::copyString(const char *data, size_t length) {
+  char *copy = (char *)allocate(length + 1, 1);
+  memcpy(copy, data, length);
+  copy[length] = '\0';
+  return llvm::StringRef(copy, length);
+}
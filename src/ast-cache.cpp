@@ -0,0 +1,451 @@
+#include <cstdio>
+#include <cstring>
+#include <cstddef>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "src/includes/ast-cache.hpp"
+#include "src/includes/flat-ast.hpp"
+
+static const char AST_CACHE_MAGIC[8] = { 'G', 'O', 'L', 'O', 'A', 'S', 'T', 'C' };
+
+/* FNV-1a over 64-bit words. Every step is a bijection of the running
+   hash, so changing any single word of the input always changes it. */
+static uint64_t hashBytes(const char *data, size_t size)
+{
+  const uint64_t prime = 0x100000001b3ULL;
+  uint64_t hash = 0xcbf29ce484222325ULL ^ size;
+  const char *p = data;
+  const char *end = p + size;
+  for (; p + 8 <= end; p += 8) {
+    uint64_t word;
+    memcpy(&word, p, 8);
+    hash = (hash ^ word) * prime;
+  }
+  for (; p < end; p++) {
+    hash = (hash ^ (unsigned char)*p) * prime;
+  }
+  return hash ^ (hash >> 29);
+}
+
+static uint64_t hashSource(const SourceBuffer& source)
+{
+  return hashBytes(source.data(), source.size());
+}
+
+std::string astCachePath(const char *sourceFileName)
+{
+  return std::string(sourceFileName) + ".astc";
+}
+
+bool writeAstCache(const char *path, const SourceBuffer& source, ParserState& state)
+{
+  FlatAst flat;
+  flat.build(*state.topLevelModule, *state.programBlock);
+
+  std::vector<uint32_t> offsets;
+  std::string names;
+  for (unsigned id = 0; id < state.symbols.size(); id++) {
+    offsets.push_back(names.size());
+    names.append(state.symbols[id]->name.data(), state.symbols[id]->name.size());
+  }
+  offsets.push_back(names.size());
+
+  AstCacheHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, AST_CACHE_MAGIC, sizeof(header.magic));
+  header.version = AST_CACHE_VERSION;
+  header.nodeSize = sizeof(FlatNode);
+  header.sourceLength = source.size();
+  header.sourceHash = hashSource(source);
+  header.nodeCount = flat.nodes.size();
+  header.childCount = flat.children.size();
+  header.symbolCount = state.symbols.size();
+  header.symbolBytes = names.size();
+  header.textBytes = flat.text.size();
+  header.module = flat.module;
+  header.root = flat.root;
+
+  std::string file;
+  file.reserve(sizeof(header) + flat.bytesUsed() + offsets.size() * sizeof(uint32_t) + names.size());
+  file.append((const char *)&header, sizeof(header));
+  file.append((const char *)&flat.nodes[0], flat.nodes.size() * sizeof(FlatNode));
+  if (!flat.children.empty()) {
+    file.append((const char *)&flat.children[0], flat.children.size() * sizeof(uint32_t));
+  }
+  file.append((const char *)&offsets[0], offsets.size() * sizeof(uint32_t));
+  file.append(names);
+  if (!flat.text.empty()) {
+    file.append(&flat.text[0], flat.text.size());
+  }
+  uint32_t payloadHash = hashBytes(file.data() + sizeof(header), file.size() - sizeof(header));
+  memcpy(&file[offsetof(AstCacheHeader, payloadHash)], &payloadHash, sizeof(payloadHash));
+
+  char temporary[4096];
+  snprintf(temporary, sizeof(temporary), "%s.%d", path, (int)getpid());
+  FILE *f = fopen(temporary, "wb");
+  if (f == NULL) {
+    return false;
+  }
+  bool written = fwrite(file.data(), 1, file.size(), f) == file.size();
+  written = fclose(f) == 0 && written;
+  if (!written || rename(temporary, path) != 0) {
+    unlink(temporary);
+    return false;
+  }
+  return true;
+}
+
+/* The parts of a mapped cache file */
+struct AstCacheView {
+  const AstCacheHeader *header;
+  const FlatNode *nodes;
+  const uint32_t *children;
+  const uint32_t *offsets;
+  const char *names;
+  const char *text;
+};
+
+static bool isExpression(const AstCacheView& cache, uint32_t index, uint32_t parent)
+{
+  if (index >= parent) {
+    return false;
+  }
+  switch (cache.nodes[index].kind) {
+    case FLAT_STRING: case FLAT_INTEGER: case FLAT_DOUBLE: case FLAT_IDENTIFIER:
+    case FLAT_METHOD_CALL: case FLAT_BINARY_OPERATOR: case FLAT_ASSIGNMENT:
+    case FLAT_BLOCK: case FLAT_MODULE: case FLAT_MATCH:
+      return true;
+  }
+  return false;
+}
+
+static bool isStatement(const AstCacheView& cache, uint32_t index, uint32_t parent)
+{
+  if (index >= parent) {
+    return false;
+  }
+  switch (cache.nodes[index].kind) {
+    case FLAT_EXPRESSION_STATEMENT: case FLAT_RETURN_STATEMENT: case FLAT_COMMENT_STATEMENT:
+    case FLAT_VARIABLE_DECLARATION: case FLAT_FUNCTION_DECLARATION: case FLAT_IF_STATEMENT:
+    case FLAT_WHILE_STATEMENT: case FLAT_FOR_STATEMENT: case FLAT_FOREACH_STATEMENT:
+      return true;
+  }
+  return false;
+}
+
+static bool isBlock(const AstCacheView& cache, uint32_t index, uint32_t parent)
+{
+  return index < parent && cache.nodes[index].kind == FLAT_BLOCK;
+}
+
+/* What a declaration may be annotated with, TYPE_UNKNOWN for nothing */
+static bool isAnnotation(uint32_t type)
+{
+  return type == TYPE_UNKNOWN || type == TYPE_INT || type == TYPE_DOUBLE
+    || (type >= TYPE_I8 && type <= TYPE_BOOL);
+}
+
+/* Checks every index before anything is built, so that a damaged file
+   is refused instead of crashing the compiler. Children must come
+   before their parent, which also rules out cycles. */
+static bool isValid(const AstCacheView& cache)
+{
+  const AstCacheHeader& header = *cache.header;
+  for (uint32_t i = 0; i < header.symbolCount; i++) {
+    if (cache.offsets[i] > cache.offsets[i + 1]) {
+      return false;
+    }
+  }
+  if (cache.offsets[header.symbolCount] != header.symbolBytes) {
+    return false;
+  }
+
+  for (uint32_t index = 0; index < header.nodeCount; index++) {
+    const FlatNode& node = cache.nodes[index];
+    uint64_t first = node.b;
+    uint64_t count = node.c;
+    switch (node.kind) {
+      case FLAT_STRING:
+      case FLAT_COMMENT_STATEMENT:
+        if ((uint64_t)node.a + node.b > header.textBytes) return false;
+        break;
+      case FLAT_INTEGER:
+      case FLAT_DOUBLE:
+        break;
+      case FLAT_IDENTIFIER:
+      case FLAT_MODULE:
+        if (node.a >= header.symbolCount) return false;
+        break;
+      case FLAT_METHOD_CALL:
+        if (node.a >= header.symbolCount || first + count > header.childCount) return false;
+        for (uint32_t i = 0; i < node.c; i++) {
+          if (!isExpression(cache, cache.children[node.b + i], index)) return false;
+        }
+        break;
+      case FLAT_BINARY_OPERATOR:
+        if (!isExpression(cache, node.a, index) || !isExpression(cache, node.b, index)) return false;
+        break;
+      case FLAT_ASSIGNMENT:
+        if (node.a >= header.symbolCount || !isExpression(cache, node.b, index)) return false;
+        break;
+      case FLAT_BLOCK:
+        if (first + count > header.childCount) return false;
+        for (uint32_t i = 0; i < node.c; i++) {
+          if (!isStatement(cache, cache.children[node.b + i], index)) return false;
+        }
+        break;
+      case FLAT_EXPRESSION_STATEMENT:
+      case FLAT_RETURN_STATEMENT:
+        if (!isExpression(cache, node.a, index)) return false;
+        break;
+      case FLAT_VARIABLE_DECLARATION:
+        if (node.a >= header.symbolCount) return false;
+        if (node.b != FLAT_NONE && !isExpression(cache, node.b, index)) return false;
+        if (!isAnnotation(node.c)) return false;
+        break;
+      case FLAT_FUNCTION_DECLARATION:
+        if (node.a >= header.symbolCount || first + 1 + 2 * count > header.childCount) return false;
+        if (cache.children[node.b] >= index || cache.nodes[cache.children[node.b]].kind != FLAT_BLOCK) return false;
+        if (!isAnnotation(node.op)) return false;
+        for (uint32_t i = 0; i < node.c; i++) {
+          if (cache.children[node.b + 1 + i] >= header.symbolCount) return false;
+          if (!isAnnotation(cache.children[node.b + 1 + node.c + i])) return false;
+        }
+        break;
+      case FLAT_IF_STATEMENT:
+        if (!isExpression(cache, node.a, index) || !isBlock(cache, node.b, index)) return false;
+        if (node.c != FLAT_NONE && !isBlock(cache, node.c, index)) return false;
+        break;
+      case FLAT_WHILE_STATEMENT:
+        if (!isExpression(cache, node.a, index) || !isBlock(cache, node.b, index)) return false;
+        break;
+      case FLAT_FOR_STATEMENT:
+        if (node.a >= index || cache.nodes[node.a].kind != FLAT_VARIABLE_DECLARATION
+            || cache.nodes[node.a].b == FLAT_NONE) return false;
+        if (!isBlock(cache, node.b, index) || (uint64_t)node.c + 2 > header.childCount) return false;
+        if (!isExpression(cache, cache.children[node.c], index)
+            || !isExpression(cache, cache.children[node.c + 1], index)) return false;
+        break;
+      case FLAT_FOREACH_STATEMENT:
+        if (node.a >= header.symbolCount || !isBlock(cache, node.b, index)
+            || (uint64_t)node.c + 3 > header.childCount) return false;
+        if (!isExpression(cache, cache.children[node.c], index)
+            || !isExpression(cache, cache.children[node.c + 1], index)) return false;
+        if (cache.children[node.c + 2] != FLAT_NONE
+            && !isExpression(cache, cache.children[node.c + 2], index)) return false;
+        break;
+      case FLAT_MATCH:
+        /* the arms of a case are blocks, and only its otherwise is optional */
+        if (node.op > 1 || node.c == 0 || first + 2 * count > header.childCount) return false;
+        for (uint32_t i = 0; i < node.c; i++) {
+          uint32_t arm = cache.children[node.b + 2 * i + 1];
+          if (!isExpression(cache, cache.children[node.b + 2 * i], index)) return false;
+          if (node.op ? !isBlock(cache, arm, index) : !isExpression(cache, arm, index)) return false;
+        }
+        if (node.op ? node.a != FLAT_NONE && !isBlock(cache, node.a, index)
+                    : !isExpression(cache, node.a, index)) return false;
+        break;
+      default:
+        return false;
+    }
+  }
+  return header.module < header.nodeCount && cache.nodes[header.module].kind == FLAT_MODULE
+    && header.root < header.nodeCount && cache.nodes[header.root].kind == FLAT_BLOCK;
+}
+
+/* Same AST the parser would have built, in the same arena */
+static void rebuild(const AstCacheView& cache, ParserState& state)
+{
+  const AstCacheHeader& header = *cache.header;
+  Arena& arena = state.arena;
+  std::vector<const Symbol*> symbols(header.symbolCount);
+  for (uint32_t i = 0; i < header.symbolCount; i++) {
+    llvm::StringRef name(cache.names + cache.offsets[i], cache.offsets[i + 1] - cache.offsets[i]);
+    symbols[i] = state.symbols.intern(name);
+  }
+
+  std::vector<Node*> built(header.nodeCount);
+  for (uint32_t index = 0; index < header.nodeCount; index++) {
+    const FlatNode& node = cache.nodes[index];
+    uint64_t bits = (uint64_t)node.b << 32 | node.a;
+    Node *result = NULL;
+
+    switch (node.kind) {
+      case FLAT_STRING:
+        result = new (arena) NString(arena.copyString(cache.text + node.a, node.b));
+        break;
+      case FLAT_INTEGER:
+        result = new (arena) NInteger((long long)bits);
+        break;
+      case FLAT_DOUBLE: {
+        double value;
+        memcpy(&value, &bits, sizeof(value));
+        result = new (arena) NDouble(value);
+        break;
+      }
+      case FLAT_IDENTIFIER:
+        result = new (arena) NIdentifier(symbols[node.a]);
+        break;
+      case FLAT_METHOD_CALL: {
+        ExpressionList arguments(arena);
+        arguments.reserve(node.c);
+        for (uint32_t i = 0; i < node.c; i++) {
+          arguments.push_back(static_cast<NExpression*>(built[cache.children[node.b + i]]));
+        }
+        result = new (arena) NMethodCall(*new (arena) NIdentifier(symbols[node.a]), arguments);
+        break;
+      }
+      case FLAT_BINARY_OPERATOR:
+        result = new (arena) NBinaryOperator(*static_cast<NExpression*>(built[node.a]), node.op,
+            *static_cast<NExpression*>(built[node.b]));
+        break;
+      case FLAT_ASSIGNMENT:
+        result = new (arena) NAssignment(*new (arena) NIdentifier(symbols[node.a]),
+            *static_cast<NExpression*>(built[node.b]));
+        break;
+      case FLAT_BLOCK: {
+        NBlock *block = new (arena) NBlock(arena);
+        block->statements.reserve(node.c);
+        for (uint32_t i = 0; i < node.c; i++) {
+          block->statements.push_back(static_cast<NStatement*>(built[cache.children[node.b + i]]));
+        }
+        result = block;
+        break;
+      }
+      case FLAT_EXPRESSION_STATEMENT:
+        result = new (arena) NExpressionStatement(*static_cast<NExpression*>(built[node.a]));
+        break;
+      case FLAT_RETURN_STATEMENT:
+        result = new (arena) NReturnStatement(*static_cast<NExpression*>(built[node.a]));
+        break;
+      case FLAT_COMMENT_STATEMENT:
+        result = new (arena) NCommentStatement(arena.copyString(cache.text + node.a, node.b));
+        break;
+      case FLAT_VARIABLE_DECLARATION: {
+        NIdentifier *id = new (arena) NIdentifier(symbols[node.a]);
+        if (node.b == FLAT_NONE) {
+          result = new (arena) NVariableDeclaration(*id, (ValueType)node.c);
+        } else {
+          result = new (arena) NVariableDeclaration(*id, static_cast<NExpression*>(built[node.b]), (ValueType)node.c);
+        }
+        break;
+      }
+      case FLAT_FUNCTION_DECLARATION: {
+        VariableList arguments(arena);
+        arguments.reserve(node.c);
+        for (uint32_t i = 0; i < node.c; i++) {
+          const Symbol *argument = symbols[cache.children[node.b + 1 + i]];
+          ValueType annotation = (ValueType)cache.children[node.b + 1 + node.c + i];
+          arguments.push_back(new (arena) NVariableDeclaration(*new (arena) NIdentifier(argument), annotation));
+        }
+        NBlock *body = static_cast<NBlock*>(built[cache.children[node.b]]);
+        result = new (arena) NFunctionDeclaration(*new (arena) NIdentifier(symbols[node.a]),
+            arguments, *body, node.flags != 0, (ValueType)node.op);
+        break;
+      }
+      case FLAT_MODULE:
+        result = new (arena) NModule(*new (arena) NIdentifier(symbols[node.a]));
+        break;
+      case FLAT_IF_STATEMENT:
+        result = new (arena) NIfStatement(*static_cast<NExpression*>(built[node.a]),
+            *static_cast<NBlock*>(built[node.b]), node.c != FLAT_NONE ? static_cast<NBlock*>(built[node.c]) : NULL);
+        break;
+      case FLAT_WHILE_STATEMENT:
+        result = new (arena) NWhileStatement(*static_cast<NExpression*>(built[node.a]),
+            *static_cast<NBlock*>(built[node.b]));
+        break;
+      case FLAT_FOR_STATEMENT:
+        result = new (arena) NForStatement(*static_cast<NVariableDeclaration*>(built[node.a]),
+            *static_cast<NExpression*>(built[cache.children[node.c]]),
+            *static_cast<NExpression*>(built[cache.children[node.c + 1]]), *static_cast<NBlock*>(built[node.b]));
+        break;
+      case FLAT_FOREACH_STATEMENT: {
+        uint32_t step = cache.children[node.c + 2];
+        result = new (arena) NForeachStatement(*new (arena) NIdentifier(symbols[node.a]),
+            *static_cast<NExpression*>(built[cache.children[node.c]]),
+            *static_cast<NExpression*>(built[cache.children[node.c + 1]]),
+            step != FLAT_NONE ? static_cast<NExpression*>(built[step]) : NULL, *static_cast<NBlock*>(built[node.b]));
+        break;
+      }
+      case FLAT_MATCH: {
+        NMatch *match = new (arena) NMatch(arena, node.op != 0);
+        match->conditions.reserve(node.c);
+        match->arms.reserve(node.c);
+        for (uint32_t i = 0; i < node.c; i++) {
+          match->conditions.push_back(static_cast<NExpression*>(built[cache.children[node.b + 2 * i]]));
+          match->arms.push_back(static_cast<NExpression*>(built[cache.children[node.b + 2 * i + 1]]));
+        }
+        match->otherwise = node.a != FLAT_NONE ? static_cast<NExpression*>(built[node.a]) : NULL;
+        result = match;
+        break;
+      }
+    }
+    built[index] = result;
+  }
+
+  state.topLevelModule = static_cast<NModule*>(built[header.module]);
+  state.programBlock = static_cast<NBlock*>(built[header.root]);
+}
+
+static bool load(const char *data, size_t size, const SourceBuffer& source, ParserState& state)
+{
+  if (size < sizeof(AstCacheHeader)) {
+    return false;
+  }
+  AstCacheView cache;
+  cache.header = (const AstCacheHeader *)data;
+  const AstCacheHeader& header = *cache.header;
+  if (memcmp(header.magic, AST_CACHE_MAGIC, sizeof(header.magic)) != 0
+      || header.version != AST_CACHE_VERSION
+      || header.nodeSize != sizeof(FlatNode)
+      || header.sourceLength != source.size()
+      || header.sourceHash != hashSource(source)) {
+    return false;
+  }
+
+  uint64_t expected = sizeof(AstCacheHeader)
+    + (uint64_t)header.nodeCount * sizeof(FlatNode)
+    + (uint64_t)header.childCount * sizeof(uint32_t)
+    + ((uint64_t)header.symbolCount + 1) * sizeof(uint32_t)
+    + header.symbolBytes + header.textBytes;
+  if (expected != size
+      || header.payloadHash != (uint32_t)hashBytes(data + sizeof(AstCacheHeader), size - sizeof(AstCacheHeader))) {
+    return false;
+  }
+  cache.nodes = (const FlatNode *)(data + sizeof(AstCacheHeader));
+  cache.children = (const uint32_t *)(cache.nodes + header.nodeCount);
+  cache.offsets = cache.children + header.childCount;
+  cache.names = (const char *)(cache.offsets + header.symbolCount + 1);
+  cache.text = cache.names + header.symbolBytes;
+
+  if (!isValid(cache)) {
+    return false;
+  }
+  rebuild(cache, state);
+  return true;
+}
+
+bool loadAstCache(const char *path, const SourceBuffer& source, ParserState& state)
+{
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) {
+    return false;
+  }
+  struct stat info;
+  if (fstat(fd, &info) != 0 || info.st_size == 0) {
+    close(fd);
+    return false;
+  }
+  size_t size = info.st_size;
+  void *data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (data == MAP_FAILED) {
+    return false;
+  }
+  bool loaded = load((const char *)data, size, source, state);
+  munmap(data, size);
+  return loaded;
+}
@@ -0,0 +1,270 @@
+#include <vector>
+#include <sys/time.h>
+#include "src/includes/ast-pass.hpp"
+
+/* -- Default traversal -- */
+
+/* As generateExpression does, each call, operator or assignment is on
+   the stack twice: first to enter it and push its operands, then to put
+   back what replaces them, which is on the result stack by then, and
+   leave it. Any other operand is visited through accept. */
+struct OperationFrame {
+  NExpression *node;
+  bool expanded; /* its operands are visited */
+};
+
+NExpression *AstVisitor::walkOperations(NExpression& root)
+{
+  std::vector<OperationFrame> work;
+  std::vector<NExpression*> results;
+  OperationFrame first = { &root, false };
+  work.push_back(first);
+
+  while (!work.empty()) {
+    OperationFrame frame = work.back();
+    work.pop_back();
+    OperationFrame operand = { NULL, false };
+
+    if (NMethodCall *node = dynamic_cast<NMethodCall*>(frame.node)) {
+      if (!frame.expanded) {
+        enter(*node);
+        frame.expanded = true;
+        work.push_back(frame);
+        for (size_t i = node->arguments.size(); i > 0; i--) {
+          operand.node = node->arguments[i - 1];
+          work.push_back(operand);
+        }
+        continue;
+      }
+      for (size_t i = node->arguments.size(); i > 0; i--) {
+        node->arguments[i - 1] = results.back();
+        results.pop_back();
+      }
+      results.push_back(leave(*node));
+    }
+    else if (NBinaryOperator *node = dynamic_cast<NBinaryOperator*>(frame.node)) {
+      if (!frame.expanded) {
+        enter(*node);
+        frame.expanded = true;
+        work.push_back(frame);
+        operand.node = node->rhs;
+        work.push_back(operand);
+        operand.node = node->lhs;
+        work.push_back(operand);
+        continue;
+      }
+      node->rhs = results.back();
+      results.pop_back();
+      node->lhs = results.back();
+      results.pop_back();
+      results.push_back(leave(*node));
+    }
+    else if (NAssignment *node = dynamic_cast<NAssignment*>(frame.node)) {
+      if (!frame.expanded) {
+        enter(*node);
+        frame.expanded = true;
+        work.push_back(frame);
+        operand.node = node->rhs;
+        work.push_back(operand);
+        continue;
+      }
+      node->rhs = results.back();
+      results.pop_back();
+      results.push_back(leave(*node));
+    }
+    else {
+      results.push_back(frame.node->accept(*this));
+    }
+  }
+  return results.back();
+}
+
+NExpression *AstVisitor::visit(NBlock& node)
+{
+  StatementList::iterator it;
+  for (it = node.statements.begin(); it != node.statements.end(); it++) {
+    (**it).accept(*this);
+  }
+  return &node;
+}
+
+NExpression *AstVisitor::visit(NMatch& node)
+{
+  for (size_t i = 0; i < node.conditions.size(); i++) {
+    node.conditions[i] = node.conditions[i]->accept(*this);
+    node.arms[i] = node.arms[i]->accept(*this);
+  }
+  if (node.otherwise != NULL) {
+    node.otherwise = node.otherwise->accept(*this);
+  }
+  return &node;
+}
+
+void AstVisitor::visit(NExpressionStatement& node)
+{
+  node.expression = node.expression->accept(*this);
+}
+
+void AstVisitor::visit(NReturnStatement& node)
+{
+  node.expression = node.expression->accept(*this);
+}
+
+void AstVisitor::visit(NVariableDeclaration& node)
+{
+  if (node.assignmentExpr != NULL) {
+    node.assignmentExpr = node.assignmentExpr->accept(*this);
+  }
+}
+
+void AstVisitor::visit(NFunctionDeclaration& node)
+{
+  node.block.accept(*this);
+}
+
+void AstVisitor::visit(NIfStatement& node)
+{
+  node.condition = node.condition->accept(*this);
+  node.thenBlock.accept(*this);
+  if (node.elseBlock != NULL) {
+    node.elseBlock->accept(*this);
+  }
+}
+
+void AstVisitor::visit(NWhileStatement& node)
+{
+  node.condition = node.condition->accept(*this);
+  node.block.accept(*this);
+}
+
+/* In the order the loop runs them first */
+void AstVisitor::visit(NForStatement& node)
+{
+  node.initializer.accept(*this);
+  node.condition = node.condition->accept(*this);
+  node.block.accept(*this);
+  node.step = node.step->accept(*this);
+}
+
+void AstVisitor::visit(NForeachStatement& node)
+{
+  node.from = node.from->accept(*this);
+  node.to = node.to->accept(*this);
+  if (node.step != NULL) {
+    node.step = node.step->accept(*this);
+  }
+  node.block.accept(*this);
+}
+
+/* -- Dispatch -- */
+
+NExpression *NString::accept(AstVisitor& visitor) { return visitor.visit(*this); }
+NExpression *NInteger::accept(AstVisitor& visitor) { return visitor.visit(*this); }
+NExpression *NDouble::accept(AstVisitor& visitor) { return visitor.visit(*this); }
+NExpression *NIdentifier::accept(AstVisitor& visitor) { return visitor.visit(*this); }
+NExpression *NMethodCall::accept(AstVisitor& visitor) { return visitor.visit(*this); }
+NExpression *NBinaryOperator::accept(AstVisitor& visitor) { return visitor.visit(*this); }
+NExpression *NAssignment::accept(AstVisitor& visitor) { return visitor.visit(*this); }
+NExpression *NBlock::accept(AstVisitor& visitor) { return visitor.visit(*this); }
+NExpression *NMatch::accept(AstVisitor& visitor) { return visitor.visit(*this); }
+NExpression *NModule::accept(AstVisitor& visitor) { return visitor.visit(*this); }
+void NExpressionStatement::accept(AstVisitor& visitor) { visitor.visit(*this); }
+void NReturnStatement::accept(AstVisitor& visitor) { visitor.visit(*this); }
+void NCommentStatement::accept(AstVisitor& visitor) { visitor.visit(*this); }
+void NVariableDeclaration::accept(AstVisitor& visitor) { visitor.visit(*this); }
+void NFunctionDeclaration::accept(AstVisitor& visitor) { visitor.visit(*this); }
+void NIfStatement::accept(AstVisitor& visitor) { visitor.visit(*this); }
+void NWhileStatement::accept(AstVisitor& visitor) { visitor.visit(*this); }
+void NForStatement::accept(AstVisitor& visitor) { visitor.visit(*this); }
+void NForeachStatement::accept(AstVisitor& visitor) { visitor.visit(*this); }
+
+/* -- Pass manager -- */
+
+static double now() {
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+AstPassManager::~AstPassManager()
+{
+  for (size_t i = 0; i < passes.size(); i++) {
+    delete passes[i].pass;
+  }
+}
+
+void AstPassManager::add(AstPass *pass, bool enabled)
+{
+  Entry entry = { pass, enabled, 0 };
+  passes.push_back(entry);
+}
+
+bool AstPassManager::enable(llvm::StringRef name, bool enabled)
+{
+  for (size_t i = 0; i < passes.size(); i++) {
+    if (name == passes[i].pass->name()) {
+      passes[i].enabled = enabled;
+      return true;
+    }
+  }
+  return false;
+}
+
+void AstPassManager::run(NBlock& root, Arena& arena)
+{
+  for (size_t i = 0; i < passes.size(); i++) {
+    if (passes[i].enabled) {
+      double start = now();
+      passes[i].pass->run(root, arena);
+      passes[i].seconds += now() - start;
+    }
+  }
+}
+
+void AstPassManager::run(NFunctionDeclaration& function, Arena& arena)
+{
+  for (size_t i = 0; i < passes.size(); i++) {
+    if (passes[i].enabled) {
+      double start = now();
+      passes[i].pass->run(function, arena);
+      passes[i].seconds += now() - start;
+    }
+  }
+}
+
+void AstPassManager::declare(NVariableDeclaration& declaration, Arena& arena)
+{
+  for (size_t i = 0; i < passes.size(); i++) {
+    if (passes[i].enabled) {
+      double start = now();
+      passes[i].pass->declare(declaration, arena);
+      passes[i].seconds += now() - start;
+    }
+  }
+}
+
+void AstPassManager::report(std::ostream& out) const
+{
+  for (size_t i = 0; i < passes.size(); i++) {
+    out << "AST pass " << passes[i].pass->name() << ": ";
+    if (!passes[i].enabled) {
+      out << "disabled" << std::endl;
+      continue;
+    }
+    out << passes[i].seconds * 1000 << " ms";
+    passes[i].pass->report(out);
+    out << std::endl;
+  }
+}
+
+std::string AstPassManager::names() const
+{
+  std::string names;
+  for (size_t i = 0; i < passes.size(); i++) {
+    if (i > 0) {
+      names += ", ";
+    }
+    names += passes[i].pass->name();
+  }
+  return names;
+}
@@ -1,5 +1,7 @@
 #include "src/includes/codegen.hpp"
+#include "src/includes/resolver.hpp"
 #include "build/parser.hpp"
+#include <algorithm>
 #include <iostream>
 #include <fstream>
 
@@ -8,8 +10,11 @@ using namespace std;
 class Debug 
 {
   public:
+    /* The indentation stops growing past 16 levels, where the depth
+       number still tells how deep the node is */
     Debug& operator()(int depth) { 
-      for(int i = 0; i < depth; i++) { std::cerr << '\t'; }
+      static const char tabs[] = "\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t";
+      std::cerr.write(tabs, std::min(depth, (int)sizeof(tabs) - 1));
       std::cerr << depth << " ";
       return *this;
     }
@@ -20,23 +25,86 @@ class Debug
         return *this;
       }
 
+    Debug& operator<<(StringRef s) {
+      std::cerr.write(s.data(), s.size());
+      return *this;
+    }
+
     Debug& operator<<(ostream& (*f)(ostream& o)) {
       std::cerr << f;
       return *this;
     };
 };
 
-CodeGenContext::CodeGenContext(std::string moduleName) {
+CodeGenContext::CodeGenContext(std::string moduleName, SymbolTable& symbols, const CodeGenOptions& options) :
+  engine(NULL), options(options), symbols(symbols), types(getGlobalContext()) {
   module = new Module(moduleName, getGlobalContext());
+  functionPasses = new FunctionPassManager(module);
+  functionPasses->add(new DataLayout(module));
+  if (options.optLevel == 0) {
+    functionPasses->add(createSROAPass());
+    functionPasses->add(createPromoteMemoryToRegisterPass());
+  }
+  else {
+    PassManagerBuilder builder;
+    populatePasses(builder);
+    builder.populateFunctionPassManager(*functionPasses);
+  }
+  /* at every level: in streaming mode the function passes are all a
+     function gets */
+  functionPasses->add(createTailCallEliminationPass());
+  functionPasses->doInitialization();
 }
 
-/* Compile the AST into a module */
+CodeGenContext::~CodeGenContext() {
+  functionPasses->doFinalization();
+  delete functionPasses;
+  if (engine != NULL) {
+    delete engine;
+  }
+  else {
+    delete module;
+  }
+}
+
+/* A let of the top level block initialized with a literal */
+static NVariableDeclaration *moduleConstant(NStatement *statement)
+{
+  NVariableDeclaration *declaration = dynamic_cast<NVariableDeclaration*>(statement);
+  return declaration != NULL && declaration->hasLiteralValue() ? declaration : NULL;
+}
+
+/* Compile the AST into a module. The constants of the module are
+   declared before any function is generated, so every function sees
+   all of them; the rest of the toplevel block goes in the entry point. */
 void CodeGenContext::generateCode(NModule& mod, NBlock& root)
 {
-  Debug debug;
   std::cerr << "Starting code generation..." << endl << std::flush;
+  FunctionResolver resolver(*this);
+  resolver.resolve(root);
+  StatementList::const_iterator it;
+  for (it = root.statements.begin(); it != root.statements.end(); it++) {
+    if (NVariableDeclaration *declaration = moduleConstant(*it)) {
+      declareConstant(declaration->id.symbol, declaration->annotation,
+                      cast<Constant>(declaration->assignmentExpr->codeGen(*this, 1)));
+    }
+  }
+  beginEntryPoint();
+  pushScope();
+  for (it = root.statements.begin(); it != root.statements.end(); it++) {
+    if (moduleConstant(*it) == NULL) {
+      (**it).codeGen(*this, 1);
+    }
+  }
+  popScope();
+  endEntryPoint(mod.ident.name);
+  std::cerr << "Code generation is done." << endl;
+}
 
-  /* Create the top level interpreter function to call as entry */
+/* Create the top level interpreter function to call as entry, and make
+   it the current block for the top level statements */
+void CodeGenContext::beginEntryPoint()
+{
   vector<Type*> argTypes;
 
   argTypes.push_back(Type::getInt32Ty(getGlobalContext()));
@@ -58,23 +126,34 @@ void CodeGenContext::generateCode(NModule& mod, NBlock& root)
 
   /* Push a new variable/block context */
   pushBlock(bblock);
-  root.codeGen(*this, 0); /* emit bytecode for the toplevel block */
+}
+
+/* Call the module's main function from the entry point and finish it */
+void CodeGenContext::endEntryPoint(StringRef moduleName)
+{
+  Debug debug;
+  BasicBlock *bblock = currentBlock();
+
+  if (!forwardCalls.empty()) {
+    debug(0) << "[ERR]" << "no such function " << (*forwardCalls.begin())->getName() << endl;
+    exit(-1);
+  }
 
-  Function * function = module->getFunction(mod.ident.name + "_main");
+  Function * function = findFunction(symbols.intern("main"));
   if (function == NULL) {
-    debug(0) << "[ERR]" << "no such function " << mod.ident.name << "_main" << endl;
+    debug(0) << "[ERR]" << "no such function " << moduleName << "_main" << endl;
     exit(-1);
   }
 
   std::vector<Value*> args;
   args.push_back(ConstantInt::get(Type::getInt64Ty(getGlobalContext()), 42, true));
   CallInst *call = CallInst::Create((llvm::Function*)function, makeArrayRef(args), "", bblock);
+  call->setCallingConv(function->getCallingConv());
   ReturnInst::Create(getGlobalContext(), ConstantInt::get(Type::getInt64Ty(getGlobalContext()),0), bblock);
   //ReturnInst::Create(getGlobalContext(), call->getCalledValue(), bblock);
   popBlock();
 
   runPasses();
-  std::cerr << "Code generation is done." << endl;
 }
 
 void CodeGenContext::printModule(std::string outputFileName) {
@@ -84,9 +163,41 @@ void CodeGenContext::printModule(std::string outputFileName) {
   module->print(os,0);
 }
 
+void CodeGenContext::optimizeFunction(Function& function) {
+  functionPasses->run(function);
+}
+
+/* The same pipeline as clang's for the level: inlining, instcombine,
+   GVN, LICM, the loop and SLP vectorizers and global DCE from -O2 on.
+   Below -O2 only always_inline functions are inlined. */
+void CodeGenContext::populatePasses(PassManagerBuilder& builder) {
+  builder.OptLevel = options.optLevel;
+  builder.SizeLevel = options.sizeLevel;
+  if (options.optLevel > 1) {
+    unsigned threshold = options.sizeLevel > 0 ? 75 : options.optLevel > 2 ? 275 : 225;
+    builder.Inliner = createFunctionInliningPass(threshold);
+  }
+  else {
+    builder.Inliner = createAlwaysInlinerPass();
+  }
+  builder.LoopVectorize = options.optLevel > 1 && options.sizeLevel == 0;
+  builder.Vectorize = options.optLevel > 2;
+}
+
 void CodeGenContext::runPasses() {
+  for (Module::iterator it = module->begin(); it != module->end(); it++) {
+    if (!it->isDeclaration()) {
+      optimizeFunction(*it);
+    }
+  }
   PassManager pm;
+  pm.add(new DataLayout(module));
   pm.add(createVerifierPass());
+  if (options.optLevel > 0) {
+    PassManagerBuilder builder;
+    populatePasses(builder);
+    builder.populateModulePassManager(pm);
+  }
   //pm.add(createPrintModulePass((raw_fd_ostream&)OutFile));
   pm.run(*module);
 }
@@ -94,29 +205,748 @@ void CodeGenContext::runPasses() {
 /* Executes the AST by running the main function */
 GenericValue CodeGenContext::runCode() {
   std::cerr << "Running code...\n";
-  ExecutionEngine *ee = EngineBuilder(module).create();
+  CodeGenOpt::Level level = options.optLevel == 0 ? CodeGenOpt::None
+                          : options.optLevel == 1 ? CodeGenOpt::Less
+                          : options.optLevel == 2 ? CodeGenOpt::Default
+                          : CodeGenOpt::Aggressive;
+  TargetOptions targetOptions;
+  targetOptions.GuaranteedTailCallOpt = true;
+  if (engine == NULL) {
+    engine = EngineBuilder(module).setOptLevel(level).setTargetOptions(targetOptions).create();
+  }
   vector<GenericValue> noargs;
-  GenericValue v = ee->runFunction(mainFunction, noargs);
+  GenericValue v = engine->runFunction(mainFunction, noargs);
   std::cerr << "Code was run.\n";
   return v;
 }
 
-/* Returns an LLVM type based on the identifier */
-static Type *typeOf(const NIdentifier& type) 
+/* -- Emission helpers --
+   The IR both ASTs lower to: the tree's codeGen methods and the flat
+   AST's walker go through these, so they emit the same module. */
+
+/* Slots all go at the top of the entry block, in the order they are
+   declared, wherever the local itself appears. That is where mem2reg
+   and SROA look for them. */
+AllocaInst* CodeGenContext::createSlot(Type *type, StringRef name)
+{
+  CodeGenBlock& function = blocks.back();
+  AllocaInst *alloc;
+  if (function.lastAlloca != NULL) {
+    alloc = new AllocaInst(type, name);
+    alloc->insertAfter(function.lastAlloca);
+  }
+  else if (function.entry->empty()) {
+    alloc = new AllocaInst(type, name, function.entry);
+  }
+  else {
+    alloc = new AllocaInst(type, name, &function.entry->front());
+  }
+  function.lastAlloca = alloc;
+  return alloc;
+}
+
+Value* CodeGenContext::declareLocal(const Symbol *symbol, ValueType valueType)
+{
+  AllocaInst *alloc = createSlot(types.llvmTypeOf(valueType), symbol->name);
+  scopes.bind(symbol, alloc);
+  return alloc;
+}
+
+/* Variables are created on first use: an unknown one is declared and
+   yields no value. */
+Value* CodeGenContext::loadLocal(const Symbol *symbol)
+{
+  Value *addr = scopes.lookup(symbol);
+  if (addr == NULL) {
+    GlobalVariable *constant = constants.lookup(symbol);
+    if (constant != NULL) {
+      return constant->getInitializer();
+    }
+    declareLocal(symbol);
+    return NULL;
+  }
+  return new LoadInst(addr, "", false, currentBlock());
+}
+
+Value* CodeGenContext::storeLocal(const Symbol *symbol, Value *value)
+{
+  Debug debug;
+  Value * addr = scopes.lookup(symbol);
+  if (addr == NULL && constants.count(symbol)) {
+    debug(0) << "[ERR]" << symbol->name << " is a constant of the module" << endl;
+    exit(-1);
+  }
+  value = convert(value, cast<PointerType>(addr->getType())->getElementType());
+  return new StoreInst(value, addr, /* volatile? */ false, /* insertAtEnd */ currentBlock());
+}
+
+/* Nothing reads the global itself, so the one a constant replaces is
+   dropped */
+void CodeGenContext::declareConstant(const Symbol *symbol, ValueType type, Constant *value)
+{
+  if (type != TYPE_UNKNOWN) {
+    value = cast<Constant>(convert(value, types.llvmTypeOf(type)));
+  }
+  GlobalVariable *&global = constants[symbol];
+  if (global != NULL) {
+    if (global->getInitializer() == value) {
+      return;
+    }
+    global->eraseFromParent();
+  }
+  global = new GlobalVariable(*module, value->getType(), /* constant */ true, GlobalValue::InternalLinkage,
+                              value, module->getModuleIdentifier() + "_" + symbol->name.str());
+}
+
+/* A function of the module by name, declared again if it was retired */
+Function* CodeGenContext::findFunction(const Symbol *symbol)
+{
+  Function *function = functions.lookup(symbol);
+  if (function == NULL) {
+    FunctionType *ftype = retired.lookup(symbol);
+    if (ftype != NULL) {
+      std::string fname = module->getModuleIdentifier() + "_" + symbol->name.str();
+      function = Function::Create(ftype, GlobalValue::ExternalLinkage, fname.c_str(), module);
+      function->setCallingConv(CallingConv::Fast);
+      functions[symbol] = function;
+    }
+  }
+  return function;
+}
+
+void CodeGenContext::retireFunction(const Symbol *symbol)
+{
+  Function *function = functions.lookup(symbol);
+  retired[symbol] = function->getFunctionType();
+  functions.erase(symbol);
+  function->eraseFromParent();
+}
+
+Function* CodeGenContext::lookupFunction(const Symbol *symbol)
+{
+  Debug debug;
+  Function *function = findFunction(symbol);
+  if (function == NULL) {
+    debug(0) << "[ERR]" << "no such function " << symbol->name << endl;
+    exit(-1);
+  }
+  return function;
+}
+
+/* Between the integer and floating point representations, which are
+   signed; a bool is whether the value is not zero, and becomes 0 or 1.
+   Anything else is left as it is. Constants are folded, and need no
+   block. */
+Value* CodeGenContext::convert(Value *value, Type *type)
+{
+  if (value == NULL || value->getType() == type) {
+    return value;
+  }
+  Type *from = value->getType();
+  if (!(from->isIntegerTy() || from->isFloatingPointTy()) || !(type->isIntegerTy() || type->isFloatingPointTy())) {
+    return value;
+  }
+  if (type->isIntegerTy(1)) {
+    CmpInst::Predicate predicate = from->isFloatingPointTy() ? CmpInst::FCMP_UNE : CmpInst::ICMP_NE;
+    if (Constant *constant = dyn_cast<Constant>(value)) {
+      return ConstantExpr::getCompare(predicate, constant, Constant::getNullValue(from));
+    }
+    if (from->isFloatingPointTy()) {
+      return new FCmpInst(*currentBlock(), predicate, value, ConstantFP::get(from, 0.0));
+    }
+    return new ICmpInst(*currentBlock(), predicate, value, ConstantInt::get(from, 0));
+  }
+  Instruction::CastOps op = CastInst::getCastOpcode(value, !from->isIntegerTy(1), type, true);
+  if (Constant *constant = dyn_cast<Constant>(value)) {
+    return ConstantExpr::getCast(op, constant, type);
+  }
+  return CastInst::Create(op, value, type, "", currentBlock());
+}
+
+Value* CodeGenContext::createCall(Function *function, const std::vector<Value*>& args)
+{
+  std::vector<Value*> converted(args);
+  Function::arg_iterator it = function->arg_begin();
+  for (size_t i = 0; i < converted.size() && it != function->arg_end(); i++, it++) {
+    converted[i] = convert(converted[i], it->getType());
+  }
+  CallInst *call = CallInst::Create(function, makeArrayRef(converted), "", currentBlock());
+  call->setCallingConv(function->getCallingConv());
+  return call;
+}
+
+/* Operands are compared as the wider of their types: floating point if
+   either is, otherwise the widest integer, signed */
+Value* CodeGenContext::createComparison(int op, Value *lhs, Value *rhs)
+{
+  Type *left = lhs->getType(), *right = rhs->getType();
+  Type *type;
+  if (left->isFloatingPointTy() || right->isFloatingPointTy()) {
+    type = types.llvmTypeOf(left->isDoubleTy() || right->isDoubleTy() ? TYPE_DOUBLE : TYPE_F32);
+  }
+  else {
+    type = left->getPrimitiveSizeInBits() >= right->getPrimitiveSizeInBits() ? left : right;
+  }
+  lhs = convert(lhs, type);
+  rhs = convert(rhs, type);
+
+  if (type->isFloatingPointTy()) {
+    CmpInst::Predicate predicate;
+    switch (op) {
+      case TCEQ: predicate = CmpInst::FCMP_OEQ; break;
+      case TCNE: predicate = CmpInst::FCMP_UNE; break;
+      case TCLT: predicate = CmpInst::FCMP_OLT; break;
+      case TCLE: predicate = CmpInst::FCMP_OLE; break;
+      case TCGT: predicate = CmpInst::FCMP_OGT; break;
+      default:   predicate = CmpInst::FCMP_OGE; break;
+    }
+    return new FCmpInst(*currentBlock(), predicate, lhs, rhs);
+  }
+  CmpInst::Predicate predicate;
+  switch (op) {
+    case TCEQ: predicate = CmpInst::ICMP_EQ; break;
+    case TCNE: predicate = CmpInst::ICMP_NE; break;
+    case TCLT: predicate = CmpInst::ICMP_SLT; break;
+    case TCLE: predicate = CmpInst::ICMP_SLE; break;
+    case TCGT: predicate = CmpInst::ICMP_SGT; break;
+    default:   predicate = CmpInst::ICMP_SGE; break;
+  }
+  return new ICmpInst(*currentBlock(), predicate, lhs, rhs);
+}
+
+/* The operands are converted to the type inferred for the result. A
+   comparison is an i1, extended to the result type if that is not a
+   bool, as when inference is disabled. */
+Value* CodeGenContext::createBinaryOperator(int op, Value *lhs, Value *rhs, ValueType type)
+{
+  const TypeDescriptor *resultType = types.get(type);
+  switch (op) {
+    case TCEQ: case TCNE: case TCLT: case TCLE: case TCGT: case TCGE:
+      return convert(createComparison(op, lhs, rhs), resultType->llvmType);
+  }
+  lhs = convert(lhs, resultType->llvmType);
+  rhs = convert(rhs, resultType->llvmType);
+  bool fp = resultType->isFloatingPoint();
+
+  Instruction::BinaryOps instr;
+  switch (op) {
+    case TPLUS:   instr = fp ? Instruction::FAdd : Instruction::Add; goto math;
+    case TMINUS:   instr = fp ? Instruction::FSub : Instruction::Sub; goto math;
+    case TMUL:     instr = fp ? Instruction::FMul : Instruction::Mul; goto math;
+    case TDIV:     instr = fp ? Instruction::FDiv : Instruction::SDiv; goto math;
+  }
+
+  return NULL;
+math:
+  return BinaryOperator::Create(instr, lhs, rhs, "", currentBlock());
+}
+
+Function* CodeGenContext::createPrototype(const Symbol *symbol, const std::vector<ValueType>& argumentTypes,
+                                          ValueType returnType, GlobalValue::LinkageTypes linkage)
+{
+  vector<Type*> argTypes;
+  for (size_t i = 0; i < argumentTypes.size(); i++) {
+    argTypes.push_back(types.llvmTypeOf(argumentTypes[i]));
+  }
+  std::string fname = module->getModuleIdentifier() + "_" + symbol->name.str();
+
+  FunctionType *ftype = FunctionType::get(types.llvmTypeOf(returnType), makeArrayRef(argTypes), false);
+  Function *function = Function::Create(ftype, linkage, fname.c_str(), module);
+  function->setCallingConv(CallingConv::Fast);
+  functions[symbol] = function;
+  return function;
+}
+
+/* A function called before it was declared already has its prototype,
+   which the declaration completes. That prototype is all dynamic, so
+   the function cannot be annotated. */
+Function* CodeGenContext::declareFunction(const Symbol *symbol, const std::vector<ValueType>& argumentTypes,
+                                          ValueType returnType, bool externalLinkage)
+{
+  Debug debug;
+  GlobalValue::LinkageTypes linkage = externalLinkage ? GlobalValue::ExternalLinkage : GlobalValue::InternalLinkage;
+  Function *function = findFunction(symbol);
+  if (function == NULL) {
+    return createPrototype(symbol, argumentTypes, returnType, linkage);
+  }
+  if (function->arg_size() != argumentTypes.size()) {
+    debug(0) << "[ERR]" << symbol->name << " takes " << argumentTypes.size() << " argument(s), but was called with "
+             << function->arg_size() << endl;
+    exit(-1);
+  }
+  FunctionType *ftype = function->getFunctionType();
+  bool sameTypes = ftype->getReturnType() == types.llvmTypeOf(returnType);
+  for (size_t i = 0; i < argumentTypes.size(); i++) {
+    sameTypes = sameTypes && ftype->getParamType(i) == types.llvmTypeOf(argumentTypes[i]);
+  }
+  if (!sameTypes) {
+    debug(0) << "[ERR]" << symbol->name << " is annotated, but was called before it was declared" << endl;
+    exit(-1);
+  }
+  function->setLinkage(linkage);
+  if (forwardCalls.erase(function)) {
+    /* Functions stay in the order they are defined, which is what
+       StreamingCodeGen::function relies on */
+    function->removeFromParent();
+    module->getFunctionList().push_back(function);
+  }
+  return function;
+}
+
+Function* CodeGenContext::callFunction(const Symbol *symbol, unsigned arity)
+{
+  Function *function = findFunction(symbol);
+  if (function == NULL) {
+    std::vector<ValueType> argumentTypes(arity, TYPE_DYNAMIC);
+    function = createPrototype(symbol, argumentTypes, TYPE_DYNAMIC, GlobalValue::ExternalLinkage);
+    forwardCalls.insert(function);
+  }
+  return function;
+}
+
+/* Gives the function its entry block, with its arguments stored in
+   locals, and makes it the current one until endFunction */
+Function* CodeGenContext::beginFunction(const Symbol *symbol, const std::vector<const Symbol*>& arguments,
+                                        const std::vector<ValueType>& argumentTypes, ValueType returnType,
+                                        bool externalLinkage)
+{
+  Debug debug;
+  Function *function = declareFunction(symbol, argumentTypes, returnType, externalLinkage);
+  if (!function->empty() || isRetired(symbol)) {
+    debug(0) << "[ERR]" << "function " << symbol->name << " is defined twice" << endl;
+    exit(-1);
+  }
+  BasicBlock *bblock = BasicBlock::Create(getGlobalContext(), "entry", function, 0);
+
+  pushBlock(bblock);
+
+  Function::arg_iterator argsValues = function->arg_begin();
+  Value* argumentValue;
+
+  for (size_t i = 0; i < arguments.size(); i++) {
+    Value *addr = declareLocal(arguments[i], argumentTypes[i]);
+
+    argumentValue = argsValues++;
+    argumentValue->setName(arguments[i]->name);
+    StoreInst *inst = new StoreInst(argumentValue, addr, false, bblock);
+  }
+  return function;
+}
+
+/* Falling off the end returns 0. A block nothing branches to, as the
+   one after a return, is dropped if it is empty. */
+void CodeGenContext::endFunction()
+{
+  BasicBlock *block = currentBlock();
+  Type *returnType = block->getParent()->getReturnType();
+  if (block->empty() && block->use_empty() && block != blocks.back().entry) {
+    block->eraseFromParent();
+  }
+  else {
+    ReturnInst::Create(getGlobalContext(), Constant::getNullValue(returnType), block);
+  }
+  popBlock();
+}
+
+/* A call whose result is returned as it is, as the last thing its block
+   does, is marked tail: TailCallElimination turns self recursion into a
+   loop, and since Golo functions are fastcc, llc -tailcallopt makes the
+   other tail calls jumps. */
+void CodeGenContext::createReturn(Value *value)
+{
+  BasicBlock *block = currentBlock();
+  Type *returnType = block->getParent()->getReturnType();
+  if (value == NULL || value->getType()->isVoidTy()) {
+    value = Constant::getNullValue(returnType);
+  }
+  else if (CallInst *call = dyn_cast<CallInst>(value)) {
+    if (!block->empty() && &block->back() == call && call->getType() == returnType) {
+      call->setTailCall();
+    }
+  }
+  value = convert(value, returnType);
+  ReturnInst::Create(getGlobalContext(), value, currentBlock());
+  startBlock(BasicBlock::Create(getGlobalContext(), "return.after"));
+}
+
+void CodeGenContext::startBlock(BasicBlock *block)
+{
+  currentBlock()->getParent()->getBasicBlockList().push_back(block);
+  blocks.back().block = block;
+}
+
+/* -- Control flow -- */
+
+void CodeGenContext::beginIf(Value *condition, bool hasElse)
+{
+  ControlFlow control = { NULL, NULL, BasicBlock::Create(getGlobalContext(), "if.end") };
+  BasicBlock *then = BasicBlock::Create(getGlobalContext(), "if.then");
+  if (hasElse) {
+    control.otherwise = BasicBlock::Create(getGlobalContext(), "if.else");
+  }
+  condition = convert(condition, types.llvmTypeOf(TYPE_BOOL));
+  BranchInst::Create(then, hasElse ? control.otherwise : control.end, condition, currentBlock());
+  controls.push_back(control);
+  startBlock(then);
+}
+
+void CodeGenContext::beginElse()
+{
+  BranchInst::Create(controls.back().end, currentBlock());
+  startBlock(controls.back().otherwise);
+}
+
+void CodeGenContext::endIf()
+{
+  ControlFlow control = controls.back();
+  controls.pop_back();
+  BranchInst::Create(control.end, currentBlock());
+  startBlock(control.end);
+}
+
+/* The condition is tested at the top of each iteration; loop rotation
+   moves it to the bottom from -O1 on */
+void CodeGenContext::beginLoop()
+{
+  ControlFlow control = { BasicBlock::Create(getGlobalContext(), "loop.cond"), NULL, NULL };
+  BranchInst::Create(control.test, currentBlock());
+  controls.push_back(control);
+  startBlock(control.test);
+}
+
+void CodeGenContext::beginLoopBody(Value *condition)
+{
+  BasicBlock *body = BasicBlock::Create(getGlobalContext(), "loop.body");
+  controls.back().end = BasicBlock::Create(getGlobalContext(), "loop.end");
+  condition = convert(condition, types.llvmTypeOf(TYPE_BOOL));
+  BranchInst::Create(body, controls.back().end, condition, currentBlock());
+  startBlock(body);
+}
+
+void CodeGenContext::beginLoopStep()
+{
+  BasicBlock *step = BasicBlock::Create(getGlobalContext(), "loop.step");
+  BranchInst::Create(step, currentBlock());
+  startBlock(step);
+}
+
+void CodeGenContext::endLoop()
 {
-  Type * charType = Type::getInt8Ty(getGlobalContext());
-  Type * stringType = Type::getInt8Ty(getGlobalContext());
+  ControlFlow control = controls.back();
+  controls.pop_back();
+  BranchInst::Create(control.test, currentBlock());
+  startBlock(control.end);
+}
 
-  if (type.name.compare("int") == 0) {
-    return Type::getInt64Ty(getGlobalContext());
+/* The bounds are computed once, before the loop, so the loop is an
+   induction variable compared with a value the loop does not change,
+   which SCEV counts and the loop passes and the vectorizer recognize.
+   How it counts depends on the step:
+   - 1 or -1: the counter itself, stepped without signed wrap, as the
+     test has just checked it is on the near side of the bound;
+   - any other constant: the number of iterations, computed before the
+     loop, and a position going from 0 up to it without unsigned wrap;
+     the counter is from + position * step, in wrapping arithmetic,
+     which lands within the range whatever the intermediate values;
+   - unknown: the counter, stepped as in endRange. */
+void CodeGenContext::beginRange(const Symbol *counter, Value *from, Value *to, Value *step)
+{
+  Debug debug;
+  Type *type = types.llvmTypeOf(TYPE_INT);
+  from = convert(from, type);
+  to = convert(to, type);
+  step = step != NULL ? convert(step, type) : ConstantInt::get(type, 1);
+  ConstantInt *constantStep = dyn_cast<ConstantInt>(step);
+  if (constantStep != NULL && constantStep->isZero()) {
+    debug(0) << "[ERR]" << "range over " << counter->name << " has a step of 0" << endl;
+    exit(-1);
+  }
+  RangeFlow range = { to, step, NULL, NULL };
+  pushScope();
+  declareLocal(counter, TYPE_INT);
+  if (constantStep != NULL && !constantStep->isOne() && !constantStep->isMinusOne()) {
+    BasicBlock *block = currentBlock();
+    bool down = constantStep->isNegative();
+    Value *distance = down ? BinaryOperator::CreateSub(from, to, "", block)
+                           : BinaryOperator::CreateSub(to, from, "", block);
+    Constant *stride = down ? ConstantExpr::getNeg(constantStep) : constantStep;
+    /* (distance - 1) / stride + 1 does not overflow for a distance up
+       to 2^64 - 1, where rounding distance up to a whole stride would */
+    Value *trips = BinaryOperator::CreateAdd(
+        BinaryOperator::CreateUDiv(BinaryOperator::CreateSub(distance, ConstantInt::get(type, 1), "", block),
+                                   stride, "", block),
+        ConstantInt::get(type, 1), "", block);
+    Value *any = new ICmpInst(*block, down ? CmpInst::ICMP_SGT : CmpInst::ICMP_SLT, from, to);
+    range.trips = SelectInst::Create(any, trips, ConstantInt::get(type, 0), "", block);
+    range.position = createSlot(type, counter->name.str() + ".position");
+    new StoreInst(ConstantInt::get(type, 0), range.position, false, block);
+    beginLoop();
+    Value *position = new LoadInst(range.position, "", false, currentBlock());
+    beginLoopBody(new ICmpInst(*currentBlock(), CmpInst::ICMP_ULT, position, range.trips));
+    Value *offset = BinaryOperator::CreateMul(position, constantStep, "", currentBlock());
+    storeLocal(counter, BinaryOperator::CreateAdd(from, offset, "", currentBlock()));
+    ranges.push_back(range);
+    return;
   }
-  else if (type.name.compare("double") == 0) {
-    return Type::getDoubleTy(getGlobalContext());
+  storeLocal(counter, from);
+  beginLoop();
+  Value *index = loadLocal(counter);
+  Value *test;
+  if (constantStep != NULL) {
+    test = new ICmpInst(*currentBlock(), constantStep->isNegative() ? CmpInst::ICMP_SGT : CmpInst::ICMP_SLT,
+                        index, to);
   }
-  else if (type.name.compare("[string]") == 0) {
-    return ArrayType::get(charType,2);
+  else {
+    /* counting up or down depends on the sign of the step, and a step
+       of 0 does not count at all */
+    Constant *zero = ConstantInt::get(type, 0);
+    Value *up = new ICmpInst(*currentBlock(), CmpInst::ICMP_SGT, step, zero);
+    Value *down = new ICmpInst(*currentBlock(), CmpInst::ICMP_SLT, step, zero);
+    Value *below = new ICmpInst(*currentBlock(), CmpInst::ICMP_SLT, index, to);
+    Value *above = new ICmpInst(*currentBlock(), CmpInst::ICMP_SGT, index, to);
+    Value *downward = BinaryOperator::Create(Instruction::And, down, above, "", currentBlock());
+    test = SelectInst::Create(up, below, downward, "", currentBlock());
   }
-  return Type::getVoidTy(getGlobalContext());
+  beginLoopBody(test);
+  ranges.push_back(range);
+}
+
+/* With a step of unknown sign, one that would reach or pass the bound
+   sets the counter to the bound instead, which ends the loop: adding
+   it could wrap around, as in range(0, 9223372036854775807, n). Inside
+   the loop the distance left to the bound is positive and fits in an
+   unsigned i64. */
+void CodeGenContext::endRange(const Symbol *counter)
+{
+  RangeFlow range = ranges.back();
+  ranges.pop_back();
+  beginLoopStep();
+  BasicBlock *block = currentBlock();
+  if (range.position != NULL) {
+    Value *position = new LoadInst(range.position, "", false, block);
+    new StoreInst(BinaryOperator::CreateNUWAdd(position, ConstantInt::get(position->getType(), 1), "", block),
+                  range.position, false, block);
+  }
+  else if (isa<ConstantInt>(range.step)) {
+    storeLocal(counter, BinaryOperator::CreateNSWAdd(loadLocal(counter), range.step, "", block));
+  }
+  else {
+    Value *index = loadLocal(counter);
+    Constant *zero = ConstantInt::get(types.llvmTypeOf(TYPE_INT), 0);
+    Value *up = new ICmpInst(*block, CmpInst::ICMP_SGT, range.step, zero);
+    Value *left = SelectInst::Create(up, BinaryOperator::CreateSub(range.bound, index, "", block),
+                                     BinaryOperator::CreateSub(index, range.bound, "", block), "", block);
+    Value *stride = SelectInst::Create(up, range.step, BinaryOperator::CreateNeg(range.step, "", block), "", block);
+    Value *more = new ICmpInst(*block, CmpInst::ICMP_UGT, left, stride);
+    Value *next = SelectInst::Create(more, BinaryOperator::CreateAdd(index, range.step, "", block),
+                                     range.bound, "", block);
+    storeLocal(counter, next);
+  }
+  endLoop();
+  popScope();
+}
+
+/* -- case and match -- */
+
+void CodeGenContext::beginMatch(ValueType type, bool hasValue)
+{
+  MatchFlow match;
+  match.arm = 0;
+  match.next = NULL;
+  match.end = BasicBlock::Create(getGlobalContext(), "match.end");
+  match.value = hasValue ? PHINode::Create(types.llvmTypeOf(type), 2, "match.value", match.end) : NULL;
+  matches.push_back(match);
+}
+
+static bool keyLess(const std::pair<double, BasicBlock*>& a, const std::pair<double, BasicBlock*>& b)
+{
+  return a.first < b.first;
+}
+
+static bool keyEqual(const std::pair<double, BasicBlock*>& a, const std::pair<double, BasicBlock*>& b)
+{
+  return a.first == b.first;
+}
+
+/* A key that comes twice goes to its first arm, and a NaN to none: the
+   arms left out are never reached, as their conditions never hold
+   before an earlier one does */
+void CodeGenContext::dispatch(Value *subject, const std::vector<Constant*>& keys)
+{
+  MatchFlow& match = matches.back();
+  bool integers = subject->getType()->isIntegerTy();
+  for (size_t i = 0; i < keys.size(); i++) {
+    match.arms.push_back(BasicBlock::Create(getGlobalContext(), "match.when"));
+    integers = integers && isa<ConstantInt>(keys[i]);
+  }
+  match.next = BasicBlock::Create(getGlobalContext(), "match.otherwise");
+
+  if (integers) {
+    Type *type = types.llvmTypeOf(TYPE_INT);
+    SwitchInst *switchInst = SwitchInst::Create(convert(subject, type), match.next, keys.size(), currentBlock());
+    SmallPtrSet<Constant*, 16> seen;
+    for (size_t i = 0; i < keys.size(); i++) {
+      ConstantInt *key = cast<ConstantInt>(convert(keys[i], type));
+      if (seen.insert(key)) {
+        switchInst->addCase(key, match.arms[i]);
+      }
+    }
+    return;
+  }
+  std::vector<std::pair<double, BasicBlock*> > sorted;
+  for (size_t i = 0; i < keys.size(); i++) {
+    double key = isa<ConstantInt>(keys[i]) ? (double)cast<ConstantInt>(keys[i])->getSExtValue()
+                                           : cast<ConstantFP>(keys[i])->getValueAPF().convertToDouble();
+    if (key == key) {
+      sorted.push_back(std::make_pair(key, match.arms[i]));
+    }
+  }
+  std::stable_sort(sorted.begin(), sorted.end(), keyLess);
+  sorted.erase(std::unique(sorted.begin(), sorted.end(), keyEqual), sorted.end());
+  createDecisionTree(convert(subject, types.llvmTypeOf(TYPE_DOUBLE)), sorted, 0, sorted.size(), match.next);
+}
+
+/* Binary search over the sorted keys: less than the middle one goes
+   left, equal to it to its arm, anything else right */
+void CodeGenContext::createDecisionTree(Value *subject, const std::vector<std::pair<double, BasicBlock*> >& keys,
+                                        size_t begin, size_t end, BasicBlock *otherwise)
+{
+  if (begin == end) {
+    BranchInst::Create(otherwise, currentBlock());
+    return;
+  }
+  size_t middle = begin + (end - begin) / 2;
+  Constant *key = ConstantFP::get(subject->getType(), keys[middle].first);
+  BasicBlock *less = BasicBlock::Create(getGlobalContext(), "match.less");
+  BasicBlock *notLess = BasicBlock::Create(getGlobalContext(), "match.equal");
+  BasicBlock *greater = BasicBlock::Create(getGlobalContext(), "match.greater");
+  BranchInst::Create(less, notLess, createComparison(TCLT, subject, key), currentBlock());
+  startBlock(notLess);
+  BranchInst::Create(keys[middle].second, greater, createComparison(TCEQ, subject, key), currentBlock());
+  startBlock(less);
+  createDecisionTree(subject, keys, begin, middle, otherwise);
+  startBlock(greater);
+  createDecisionTree(subject, keys, middle + 1, end, otherwise);
+}
+
+void CodeGenContext::beginWhen(Value *condition)
+{
+  MatchFlow& match = matches.back();
+  if (!match.arms.empty()) {
+    startBlock(match.arms[match.arm++]);
+    return;
+  }
+  BasicBlock *when = BasicBlock::Create(getGlobalContext(), "match.when");
+  match.next = BasicBlock::Create(getGlobalContext(), "match.next");
+  condition = convert(condition, types.llvmTypeOf(TYPE_BOOL));
+  BranchInst::Create(when, match.next, condition, currentBlock());
+  startBlock(when);
+}
+
+void CodeGenContext::endWhen(Value *value)
+{
+  MatchFlow& match = matches.back();
+  if (match.value != NULL) {
+    value = convert(value, match.value->getType());
+    match.value->addIncoming(value, currentBlock());
+  }
+  BranchInst::Create(match.end, currentBlock());
+  if (match.arms.empty()) {
+    startBlock(match.next);
+  }
+}
+
+void CodeGenContext::beginOtherwise()
+{
+  if (!matches.back().arms.empty()) {
+    startBlock(matches.back().next);
+  }
+}
+
+Value* CodeGenContext::endMatch(Value *value)
+{
+  MatchFlow match = matches.back();
+  matches.pop_back();
+  if (match.value != NULL) {
+    value = convert(value, match.value->getType());
+    match.value->addIncoming(value, currentBlock());
+  }
+  BranchInst::Create(match.end, currentBlock());
+  startBlock(match.end);
+  return match.value;
+}
+
+/* Calls, operators and assignments are generated from a work stack
+   rather than by recursing through codeGen, so that how deep an
+   expression nests is only limited by memory. Each of them is on the
+   stack twice: first to push its operands, then to combine their
+   values, which are on the value stack by then. Any other node is
+   generated by its own codeGen. */
+struct ExpressionFrame {
+  NExpression *node;
+  int depth;
+  bool expanded; /* its operands are generated */
+};
+
+Value* CodeGenContext::generateExpression(NExpression& root, int depth)
+{
+  Debug debug;
+  SmallVector<ExpressionFrame, 32> work;
+  SmallVector<Value*, 32> values;
+  ExpressionFrame first = { &root, depth, false };
+  work.push_back(first);
+
+  while (!work.empty()) {
+    ExpressionFrame frame = work.pop_back_val();
+    ExpressionFrame operand = { NULL, frame.depth + 1, false };
+
+    if (NBinaryOperator *node = dynamic_cast<NBinaryOperator*>(frame.node)) {
+      if (!frame.expanded) {
+        debug(frame.depth) << "Creating binary operation " << node->op << endl;
+        frame.expanded = true;
+        work.push_back(frame);
+        operand.node = node->rhs;
+        work.push_back(operand);
+        operand.node = node->lhs;
+        work.push_back(operand);
+        continue;
+      }
+      Value *right = values.pop_back_val();
+      Value *left = values.pop_back_val();
+      values.push_back(createBinaryOperator(node->op, left, right, node->type));
+    }
+    else if (NMethodCall *node = dynamic_cast<NMethodCall*>(frame.node)) {
+      if (!frame.expanded) {
+        frame.expanded = true;
+        work.push_back(frame);
+        for (size_t i = node->arguments.size(); i > 0; i--) {
+          operand.node = node->arguments[i - 1];
+          work.push_back(operand);
+        }
+        continue;
+      }
+      std::vector<Value*> args(values.end() - node->arguments.size(), values.end());
+      values.resize(values.size() - node->arguments.size());
+      values.push_back(createCall(node->callee, args));
+      debug(frame.depth) << "Creating method call: " << node->callee->getName() << endl;
+    }
+    else if (NAssignment *node = dynamic_cast<NAssignment*>(frame.node)) {
+      if (!frame.expanded) {
+        debug(frame.depth) << "Creating assignment for " << node->lhs.name << endl;
+        frame.expanded = true;
+        work.push_back(frame);
+        operand.node = node->rhs;
+        work.push_back(operand);
+        continue;
+      }
+      Value *value = values.pop_back_val();
+      values.push_back(storeLocal(node->lhs.symbol, value));
+    }
+    else {
+      values.push_back(frame.node->codeGen(*this, frame.depth));
+    }
+  }
+  return values.back();
 }
 
 /* -- Code Generation -- */
@@ -134,27 +964,25 @@ Value* NInteger::codeGen(CodeGenContext& context, int depth)
 {
   Debug debug;
   debug(depth) << "Creating integer: " << value << endl;
-  return ConstantInt::get(Type::getInt64Ty(getGlobalContext()), value, true);
+  return ConstantInt::get(context.types.llvmTypeOf(TYPE_INT), value, true);
 }
 
 Value* NDouble::codeGen(CodeGenContext& context, int depth)
 {
   Debug debug;
   debug(depth) << "Creating double: " << value << endl;
-  return ConstantFP::get(Type::getDoubleTy(getGlobalContext()), value);
+  return ConstantFP::get(context.types.llvmTypeOf(TYPE_DOUBLE), value);
 }
 
 Value* NIdentifier::codeGen(CodeGenContext& context, int depth)
 {
   Debug debug;
   debug(depth) << "Creating identifier reference: " << name << endl;
-  if (context.locals().find(name) == context.locals().end()) {
-    AllocaInst *alloc = new AllocaInst(typeOf(*(new NIdentifier("int"))), name.c_str(), context.currentBlock());
-    context.locals()[name] = alloc;
+  Value *value = context.loadLocal(symbol);
+  if (value == NULL) {
     debug(depth) << "undeclared variable " << name << "... declaring it." << endl;
-    return NULL;
   }
-  return new LoadInst(context.locals()[name], "", false, context.currentBlock());
+  return value;
 }
 
 Value* NModule::codeGen(CodeGenContext& context, int depth)
@@ -171,64 +999,17 @@ Value* NModule::codeGen(CodeGenContext& context, int depth)
 
 Value* NMethodCall::codeGen(CodeGenContext& context, int depth)
 {
-  Debug debug;
-  std::string fname = context.module->getModuleIdentifier() + "_" + id.name;
-  Function *function = context.module->getFunction(fname.c_str());
-  if (function == NULL) {
-    debug(depth) << "[ERR]" << "no such function " << fname << endl;
-    exit(-1);
-  }
-  std::vector<Value*> args;
-  ExpressionList::const_iterator it;
-  for (it = arguments.begin(); it != arguments.end(); it++) {
-    args.push_back((**it).codeGen(context, depth + 1));
-  }
-  CallInst *call = CallInst::Create(function, makeArrayRef(args), "", context.currentBlock());
-  debug(depth) << "Creating method call: " << fname << endl;
-  return call;
+  return context.generateExpression(*this, depth);
 }
 
 Value* NBinaryOperator::codeGen(CodeGenContext& context, int depth)
 {
-  Debug debug;
-  debug(depth) << "Creating binary operation " << op << endl;
-  Instruction::BinaryOps instr;
-  switch (op) {
-    case TPLUS:   instr = Instruction::Add; goto math;
-    case TMINUS:   instr = Instruction::Sub; goto math;
-    case TMUL:     instr = Instruction::Mul; goto math;
-    case TDIV:     instr = Instruction::SDiv; goto math;
-
-                  /* TODO comparison */
-  }
-
-  return NULL;
-math:
-  return BinaryOperator::Create(instr, lhs.codeGen(context, depth + 1), 
-      rhs.codeGen(context, depth + 1), "", context.currentBlock());
+  return context.generateExpression(*this, depth);
 }
 
 Value* NAssignment::codeGen(CodeGenContext& context, int depth)
 {
-  Debug debug;
-  debug(depth) << "Creating assignment for " << lhs.name << endl;
-  // cannot really happen in fact, as we create variables on the fly
-  // I think the variables should be declared though, so something's
-  // required to change to have a special case for func arguments
-  //FIXME: la declaration de variable devrait se faire apres l'assignment?
-  //if (context.locals().find(lhs.name) == context.locals().end()) {
-  //  debug(depth) << "[ERR]" << "undeclared variable " << lhs.name << endl;
-  //  return NULL;
-  //}
-  Value * val  = rhs.codeGen(context, depth + 1);
-  debug(depth) << "1Creating assignment for " << lhs.name << endl;
-
-  Type * type = typeOf(*(new NIdentifier("int")));
-  //AllocaInst *alloc = new AllocaInst(typeOf(*(new NIdentifier("int"))), lhs.name.c_str(), context.currentBlock());
-  //context.locals()[lhs.name] = alloc;
-
-  Value * addr = context.locals()[lhs.name];
-  return new StoreInst(val, addr, /* volatile? */ false, /* insertAtEnd */ context.currentBlock());
+  return context.generateExpression(*this, depth);
 }
 
 Value* NBlock::codeGen(CodeGenContext& context, int depth)
@@ -236,10 +1017,12 @@ Value* NBlock::codeGen(CodeGenContext& context, int depth)
   Debug debug;
   StatementList::const_iterator it;
   Value *last = NULL;
+  context.pushScope();
   for (it = statements.begin(); it != statements.end(); it++) {
     debug(depth) << "Generating code for " << typeid(**it).name() << endl;
     last = (**it).codeGen(context, depth + 1);
   }
+  context.popScope();
   debug(depth) << "Creating block" << endl;
   return last;
 }
@@ -247,16 +1030,16 @@ Value* NBlock::codeGen(CodeGenContext& context, int depth)
 Value* NExpressionStatement::codeGen(CodeGenContext& context, int depth)
 {
   Debug debug;
-  debug(depth) << "Generating code for " << typeid(expression).name() << endl;
-  return expression.codeGen(context, depth + 1);
+  debug(depth) << "Generating code for " << typeid(*expression).name() << endl;
+  return expression->codeGen(context, depth + 1);
 }
 
 Value* NReturnStatement::codeGen(CodeGenContext& context, int depth)
 {
   Debug debug;
-  debug(depth) << "Generating return code for " << typeid(expression).name() << endl;
-  Value *returnValue = expression.codeGen(context, depth + 1);
-  context.setCurrentReturnValue(returnValue);
+  debug(depth) << "Generating return code for " << typeid(*expression).name() << endl;
+  Value *returnValue = expression->codeGen(context, depth + 1);
+  context.createReturn(returnValue);
   return returnValue;
 }
 
@@ -264,18 +1047,125 @@ Value* NCommentStatement::codeGen(CodeGenContext& context, int depth)
 {
   Debug debug;
   debug(depth) << "Generating comment code for " << typeid(comment).name() << endl;
-  Value *returnValue = context.getCurrentReturnValue();
-  context.setCurrentReturnValue(returnValue);
-  return returnValue;
+  return NULL;
+}
+
+Value* NIfStatement::codeGen(CodeGenContext& context, int depth)
+{
+  Debug debug;
+  debug(depth) << "Creating if" << (elseBlock != NULL ? " with else" : "") << endl;
+  Value *test = condition->codeGen(context, depth + 1);
+  context.beginIf(test, elseBlock != NULL);
+  thenBlock.codeGen(context, depth + 1);
+  if (elseBlock != NULL) {
+    context.beginElse();
+    elseBlock->codeGen(context, depth + 1);
+  }
+  context.endIf();
+  return NULL;
+}
+
+Value* NWhileStatement::codeGen(CodeGenContext& context, int depth)
+{
+  Debug debug;
+  debug(depth) << "Creating while loop" << endl;
+  context.beginLoop();
+  Value *test = condition->codeGen(context, depth + 1);
+  context.beginLoopBody(test);
+  block.codeGen(context, depth + 1);
+  context.endLoop();
+  return NULL;
+}
+
+Value* NForStatement::codeGen(CodeGenContext& context, int depth)
+{
+  Debug debug;
+  debug(depth) << "Creating for loop over " << initializer.id.name << endl;
+  context.pushScope();
+  initializer.codeGen(context, depth + 1);
+  context.beginLoop();
+  Value *test = condition->codeGen(context, depth + 1);
+  context.beginLoopBody(test);
+  block.codeGen(context, depth + 1);
+  context.beginLoopStep();
+  step->codeGen(context, depth + 1);
+  context.endLoop();
+  context.popScope();
+  return NULL;
+}
+
+Value* NForeachStatement::codeGen(CodeGenContext& context, int depth)
+{
+  Debug debug;
+  debug(depth) << "Creating foreach over " << id.name << endl;
+  Value *first = from->codeGen(context, depth + 1);
+  Value *last = to->codeGen(context, depth + 1);
+  Value *increment = step != NULL ? step->codeGen(context, depth + 1) : NULL;
+  context.beginRange(id.symbol, first, last, increment);
+  block.codeGen(context, depth + 1);
+  context.endRange(id.symbol);
+  return NULL;
+}
+
+/* The key a `subject == key` condition compares an identifier with, or
+   NULL if the condition is anything else or compares another subject */
+static Constant *keyOf(CodeGenContext& context, NExpression *condition, const Symbol *&subject)
+{
+  NBinaryOperator *comparison = dynamic_cast<NBinaryOperator*>(condition);
+  if (comparison == NULL || comparison->op != TCEQ) {
+    return NULL;
+  }
+  NIdentifier *ident = dynamic_cast<NIdentifier*>(comparison->lhs);
+  NExpression *key = comparison->rhs;
+  if (ident == NULL) {
+    ident = dynamic_cast<NIdentifier*>(comparison->rhs);
+    key = comparison->lhs;
+  }
+  if (ident == NULL || (subject != NULL && ident->symbol != subject)) {
+    return NULL;
+  }
+  subject = ident->symbol;
+  if (NInteger *integer = dynamic_cast<NInteger*>(key)) {
+    return ConstantInt::get(context.types.llvmTypeOf(TYPE_INT), integer->value, true);
+  }
+  if (NDouble *real = dynamic_cast<NDouble*>(key)) {
+    return ConstantFP::get(context.types.llvmTypeOf(TYPE_DOUBLE), real->value);
+  }
+  return NULL;
+}
+
+Value* NMatch::codeGen(CodeGenContext& context, int depth)
+{
+  Debug debug;
+  debug(depth) << "Creating " << (isCase ? "case" : "match") << " with " << arms.size() << " arm(s)" << endl;
+  const Symbol *subject = NULL;
+  std::vector<Constant*> keys;
+  for (size_t i = 0; i < conditions.size(); i++) {
+    Constant *key = keyOf(context, conditions[i], subject);
+    if (key == NULL) {
+      break;
+    }
+    keys.push_back(key);
+  }
+  context.beginMatch(type, !isCase);
+  Value *value = keys.size() == conditions.size() ? context.loadLocal(subject) : NULL;
+  if (value != NULL) {
+    debug(depth) << "dispatched on " << subject->name << endl;
+    context.dispatch(value, keys);
+  }
+  for (size_t i = 0; i < arms.size(); i++) {
+    context.beginWhen(value != NULL ? NULL : conditions[i]->codeGen(context, depth + 1));
+    context.endWhen(arms[i]->codeGen(context, depth + 1));
+  }
+  context.beginOtherwise();
+  return context.endMatch(otherwise != NULL ? otherwise->codeGen(context, depth + 1) : NULL);
 }
 
 Value* NVariableDeclaration::codeGen(CodeGenContext& context, int depth)
 {
   Debug debug;
   debug(depth) << "Creating variable declaration " << id.name << endl;
-  Type * type = typeOf(*(new NIdentifier("int")));
-  AllocaInst *alloc = new AllocaInst(type, id.name.c_str(), context.currentBlock());
-  context.locals()[id.name] = alloc;
+  context.declareLocal(id.symbol, annotation != TYPE_UNKNOWN ? annotation : id.type);
   if (assignmentExpr != NULL) {
     debug(depth + 1) << "and assign expr..." << endl;
     NAssignment assn(id, *assignmentExpr);
@@ -285,62 +1175,23 @@ Value* NVariableDeclaration::codeGen(CodeGenContext& context, int depth)
     debug(depth + 1) << "but without assign expr..." << endl;
   }
   return NULL;
-  return context.locals()[id.name];
 }
 
 Value* NFunctionDeclaration::codeGen(CodeGenContext& context, int depth)
 {
   Debug debug;
-  vector<Type*> argTypes;
+  std::vector<const Symbol*> argumentSymbols;
+  std::vector<ValueType> argumentTypes;
   VariableList::const_iterator it;
-  GlobalValue::LinkageTypes linkage;
-
-  if (externalLinkage) {
-    linkage = GlobalValue::ExternalLinkage;
-  }
-  else {
-    linkage = GlobalValue::InternalLinkage;
-  }
-  for (it = arguments.begin(); it != arguments.end(); it++) {
-    //argTypes.push_back(typeOf((**it).type));
-    argTypes.push_back(typeOf(*(new NIdentifier("int"))));
-  }
-  std::string fname = context.module->getModuleIdentifier() + "_" + id.name;
-
-  NIdentifier * typeIdentifier;
-
-  //if(fname == "main") {
-  //  debug(depth) << "renaming main to _golo_entry_point " << endl;
-  //  fname = "_golo_entry_point";
-  //  typeIdentifier = new NIdentifier("[string]");
-  //} else {
-  //  typeIdentifier = new NIdentifier("int");
-  //}
-  //TODO: unforce
-  typeIdentifier = new NIdentifier("int");
-
-  debug(depth) << "Function " << fname.c_str() << " has " << arguments.size() << " argument(s)" << endl;
-  FunctionType *ftype = FunctionType::get(typeOf(*typeIdentifier), makeArrayRef(argTypes), false);
-  Function *function = Function::Create(ftype, linkage, fname.c_str(), context.module);
-  BasicBlock *bblock = BasicBlock::Create(getGlobalContext(), "entry", function, 0);
-
-  context.pushBlock(bblock);
-
-  Function::arg_iterator argsValues = function->arg_begin();
-  Value* argumentValue;
 
   for (it = arguments.begin(); it != arguments.end(); it++) {
-    (**it).codeGen(context, depth + 1);
-
-    argumentValue = argsValues++;
-    argumentValue->setName((**it).id.name.c_str());
-    StoreInst *inst = new StoreInst(argumentValue, context.locals()[(*it)->id.name], false, bblock);
+    argumentSymbols.push_back((**it).id.symbol);
+    argumentTypes.push_back((**it).annotation != TYPE_UNKNOWN ? (**it).annotation : TYPE_DYNAMIC);
   }
-
+  debug(depth) << "Function " << id.name << " has " << arguments.size() << " argument(s)" << endl;
+  Function *function = context.beginFunction(id.symbol, argumentSymbols, argumentTypes, returnAnnotation, externalLinkage);
   block.codeGen(context, depth + 1);
-  ReturnInst::Create(getGlobalContext(), context.getCurrentReturnValue(), bblock);
-
-  context.popBlock();
+  context.endFunction();
   debug(depth) << "Creating function: " << id.name << endl;
   return function;
 }
@@ -0,0 +1,260 @@
+#include <climits>
+#include "src/includes/const-fold.hpp"
+#include "build/parser.hpp"
+
+void ConstantFolder::run(NBlock& root, Arena& arena)
+{
+  for (size_t i = 0; i < root.statements.size(); i++) {
+    if (NVariableDeclaration *declaration = dynamic_cast<NVariableDeclaration*>(root.statements[i])) {
+      declare(*declaration, arena);
+    }
+  }
+  this->arena = &arena;
+  foldFunction(root, NULL);
+}
+
+void ConstantFolder::run(NFunctionDeclaration& function, Arena& arena)
+{
+  this->arena = &arena;
+  foldFunction(function.block, &function.arguments);
+}
+
+/* Folds the initializer, which may read the constants declared before,
+   and records the literal it comes to. A later let of the same name
+   replaces the constant. */
+void ConstantFolder::declare(NVariableDeclaration& declaration, Arena& arena)
+{
+  this->arena = &arena;
+  LocalMap *enclosing = locals;
+  LocalMap initializerLocals;
+  locals = &initializerLocals;
+  AstVisitor::visit(declaration);
+  locals = enclosing;
+
+  if (!declaration.hasLiteralValue()) {
+    constants.erase(declaration.id.symbol);
+    return;
+  }
+  Local& constant = constants[declaration.id.symbol];
+  constant.value = NULL;
+  if (declaration.annotation == TYPE_UNKNOWN || declaration.annotation == declaration.assignmentExpr->type) {
+    constant.value = declaration.assignmentExpr;
+  }
+}
+
+void ConstantFolder::report(std::ostream& out) const
+{
+  out << ", " << eliminated << " node(s) eliminated, " << folded << " operation(s) folded, "
+      << propagated << " read(s) propagated, " << removed << " declaration(s) removed";
+}
+
+/* Marks the locals assigned in a function, wherever the assignment is.
+   Those are never propagated. Neither are the names declared in a block
+   nested in the function's, by a loop or an if, or counted by a
+   foreach: such a name hides the one outside only until its block
+   ends. The names declared in the function's own block are recorded
+   too, as not assigned: they hide a constant of the module. */
+class AssignmentMarker : public AstVisitor {
+  public:
+    AssignmentMarker(llvm::DenseMap<const Symbol*, bool>& assigned) : assigned(assigned), blocks(0) { }
+
+    virtual void enter(NAssignment& node) {
+      assigned[node.lhs.symbol] = true;
+    }
+    virtual NExpression *visit(NBlock& node) {
+      blocks++;
+      AstVisitor::visit(node);
+      blocks--;
+      return &node;
+    }
+    virtual void visit(NVariableDeclaration& node) {
+      if (blocks > 1) {
+        assigned[node.id.symbol] = true;
+      } else {
+        assigned.insert(std::make_pair(node.id.symbol, false));
+      }
+      AstVisitor::visit(node);
+    }
+    virtual void visit(NForStatement& node) {
+      assigned[node.initializer.id.symbol] = true;
+      AstVisitor::visit(node);
+    }
+    virtual void visit(NForeachStatement& node) {
+      assigned[node.id.symbol] = true;
+      AstVisitor::visit(node);
+    }
+    /* a nested function is marked when it is folded */
+    virtual void visit(NFunctionDeclaration& node) { }
+    using AstVisitor::visit;
+
+  private:
+    llvm::DenseMap<const Symbol*, bool>& assigned;
+    unsigned blocks; /* the function's own is the first */
+};
+
+/* Each function has locals of its own: those of the enclosing function
+   are not visible in a nested one */
+void ConstantFolder::foldFunction(NBlock& body, const VariableList *arguments)
+{
+  LocalMap *enclosing = locals;
+  LocalMap functionLocals;
+  locals = &functionLocals;
+
+  if (arguments != NULL) {
+    VariableList::const_iterator argument;
+    for (argument = arguments->begin(); argument != arguments->end(); argument++) {
+      functionLocals[(**argument).id.symbol].bound = true;
+    }
+  }
+  llvm::DenseMap<const Symbol*, bool> assigned;
+  AssignmentMarker marker(assigned);
+  body.accept(marker);
+  llvm::DenseMap<const Symbol*, bool>::iterator it;
+  for (it = assigned.begin(); it != assigned.end(); it++) {
+    functionLocals[it->first].assigned = it->second;
+    functionLocals[it->first].bound = true;
+  }
+
+  body.accept(*this);
+  removeDeadLets(body);
+
+  locals = enclosing;
+}
+
+static bool isLiteral(const NExpression *expression)
+{
+  return dynamic_cast<const NInteger*>(expression) != NULL
+      || dynamic_cast<const NDouble*>(expression) != NULL;
+}
+
+NExpression *ConstantFolder::visit(NIdentifier& node)
+{
+  Local& local = (*locals)[node.symbol];
+  if (!local.bound) {
+    LocalMap::iterator constant = constants.find(node.symbol);
+    if (constant != constants.end()) {
+      if (constant->second.value == NULL) {
+        constant->second.reads++;
+        return &node;
+      }
+      propagated++;
+      return copyLiteral(constant->second.value);
+    }
+  }
+  if (local.value == NULL) {
+    local.reads++;
+    return &node;
+  }
+  propagated++;
+  return copyLiteral(local.value);
+}
+
+void ConstantFolder::visit(NVariableDeclaration& node)
+{
+  AstVisitor::visit(node);
+  /* a later declaration of the same name replaces the value. An
+     annotation of another type than the literal's converts it. */
+  Local& local = (*locals)[node.id.symbol];
+  local.value = NULL;
+  if (!local.assigned && isLiteral(node.assignmentExpr)
+      && (node.annotation == TYPE_UNKNOWN || node.annotation == node.assignmentExpr->type)) {
+    local.value = node.assignmentExpr;
+  }
+}
+
+void ConstantFolder::visit(NFunctionDeclaration& node)
+{
+  foldFunction(node.block, &node.arguments);
+}
+
+/* Integers wrap around, as the add, sub and mul code generation emits
+   do. The divisions LLVM leaves undefined are left to the program. */
+static bool foldIntegers(int op, long long lhs, long long rhs, long long& result)
+{
+  unsigned long long left = lhs, right = rhs;
+  switch (op) {
+    case TPLUS:  result = (long long)(left + right); return true;
+    case TMINUS: result = (long long)(left - right); return true;
+    case TMUL:   result = (long long)(left * right); return true;
+    case TDIV:
+      if (rhs == 0 || (lhs == LLONG_MIN && rhs == -1)) {
+        return false;
+      }
+      result = lhs / rhs;
+      return true;
+  }
+  return false;
+}
+
+static bool foldDoubles(int op, double lhs, double rhs, double& result)
+{
+  switch (op) {
+    case TPLUS:  result = lhs + rhs; return true;
+    case TMINUS: result = lhs - rhs; return true;
+    case TMUL:   result = lhs * rhs; return true;
+    case TDIV:   result = lhs / rhs; return true;
+  }
+  return false;
+}
+
+/* Both operands must be literals of the same kind once folded: code
+   generation does not convert between integers and doubles */
+NExpression *ConstantFolder::leave(NBinaryOperator& node)
+{
+  NExpression *result = NULL;
+  NInteger *leftInteger = dynamic_cast<NInteger*>(node.lhs);
+  NInteger *rightInteger = dynamic_cast<NInteger*>(node.rhs);
+  NDouble *leftDouble = dynamic_cast<NDouble*>(node.lhs);
+  NDouble *rightDouble = dynamic_cast<NDouble*>(node.rhs);
+
+  if (leftInteger != NULL && rightInteger != NULL) {
+    long long value;
+    if (foldIntegers(node.op, leftInteger->value, rightInteger->value, value)) {
+      result = new (*arena) NInteger(value);
+    }
+  } else if (leftDouble != NULL && rightDouble != NULL) {
+    double value;
+    if (foldDoubles(node.op, leftDouble->value, rightDouble->value, value)) {
+      result = new (*arena) NDouble(value);
+    }
+  }
+  if (result == NULL) {
+    return &node;
+  }
+  folded++;
+  eliminated += 2; /* the operator and its operands make one literal */
+  return result;
+}
+
+/* Every use gets a node of its own, the tree stays a tree */
+NExpression *ConstantFolder::copyLiteral(NExpression *literal)
+{
+  if (NInteger *integer = dynamic_cast<NInteger*>(literal)) {
+    return new (*arena) NInteger(integer->value);
+  }
+  return new (*arena) NDouble(static_cast<NDouble*>(literal)->value);
+}
+
+/* Lets whose every read was replaced have nothing left to hold. The
+   reads of a constant of the module count for the let of the top
+   level block that declares it. */
+void ConstantFolder::removeDeadLets(NBlock& body)
+{
+  size_t kept = 0;
+  for (size_t i = 0; i < body.statements.size(); i++) {
+    NStatement *statement = body.statements[i];
+    NVariableDeclaration *declaration = dynamic_cast<NVariableDeclaration*>(statement);
+    if (declaration != NULL && isLiteral(declaration->assignmentExpr)) {
+      const Local& local = (*locals)[declaration->id.symbol];
+      LocalMap::const_iterator constant = constants.find(declaration->id.symbol);
+      unsigned reads = local.reads + (constant != constants.end() ? constant->second.reads : 0);
+      if (!local.assigned && reads == 0) {
+        removed++;
+        eliminated += 3; /* the declaration, its name and its value */
+        continue;
+      }
+    }
+    body.statements[kept++] = statement;
+  }
+  body.statements.truncate(kept);
+}
@@ -2,11 +2,6 @@
 #include "src/includes/codegen.hpp"
 #include "src/includes/node.h"
 
-extern int yyparse();
-extern NBlock* programBlock;
-extern Module* topLevelModule;
-
-
 llvm::Function* createPrintfFunction(CodeGenContext& context)
 {
   std::vector<llvm::Type*> printf_arg_types;
@@ -39,6 +34,7 @@ void createPrintlnFunction(CodeGenContext& context, llvm::Function* printfFn)
       llvm::Twine("llvm_golo_println"),
       context.module
       );
+  context.functions[context.symbols.intern("println")] = func;
   llvm::BasicBlock *bblock = llvm::BasicBlock::Create(getGlobalContext(), "entry", func, 0);
   context.pushBlock(bblock);
 
@@ -0,0 +1,489 @@
+#include "src/includes/descent-parser.hpp"
+
+/* Binding power of the binary operators, 0 for anything else.
+   Comparisons bind loosest and do not chain, as in parser.y. */
+enum {
+  PREC_NONE = 0,
+  PREC_COMPARISON = 1,
+  PREC_ADDITIVE = 2,
+  PREC_MULTIPLICATIVE = 3
+};
+
+static int precedenceOf(int token) {
+  switch (token) {
+    case TCEQ: case TCNE: case TCLT: case TCLE: case TCGT: case TCGE:
+      return PREC_COMPARISON;
+    case TPLUS: case TMINUS:
+      return PREC_ADDITIVE;
+    case TMUL: case TDIV:
+      return PREC_MULTIPLICATIVE;
+  }
+  return PREC_NONE;
+}
+
+static const char *tokenName(int token) {
+  switch (token) {
+    case 0: return "end of file";
+    case TIDENTIFIER: return "TIDENTIFIER";
+    case TINTEGER: return "TINTEGER";
+    case TSTRING: return "TSTRING";
+    case TDOUBLE: return "TDOUBLE";
+    case TMODULE: return "TMODULE";
+    case TCOMMENT_BEG: return "TCOMMENT_BEG";
+    case TCEQ: return "TCEQ";
+    case TCNE: return "TCNE";
+    case TCLT: return "TCLT";
+    case TCLE: return "TCLE";
+    case TCGT: return "TCGT";
+    case TCGE: return "TCGE";
+    case TEQUAL: return "TEQUAL";
+    case TPIPE: return "TPIPE";
+    case TLPAREN: return "TLPAREN";
+    case TRPAREN: return "TRPAREN";
+    case TLBRACE: return "TLBRACE";
+    case TRBRACE: return "TRBRACE";
+    case TCOMMA: return "TCOMMA";
+    case TDOT: return "TDOT";
+    case TPLUS: return "TPLUS";
+    case TMINUS: return "TMINUS";
+    case TMUL: return "TMUL";
+    case TDIV: return "TDIV";
+    case TRETURN: return "TRETURN";
+    case TFUNC: return "TFUNC";
+    case TLET: return "TLET";
+    case TVISIBILITY: return "TVISIBILITY";
+    case TCOLON: return "TCOLON";
+    case TIF: return "TIF";
+    case TELSE: return "TELSE";
+    case TWHILE: return "TWHILE";
+    case TFOR: return "TFOR";
+    case TFOREACH: return "TFOREACH";
+    case TIN: return "TIN";
+    case TCASE: return "TCASE";
+    case TMATCH: return "TMATCH";
+    case TWHEN: return "TWHEN";
+    case TTHEN: return "TTHEN";
+    case TOTHERWISE: return "TOTHERWISE";
+  }
+  return "unknown token";
+}
+
+DescentParser::DescentParser(TokenSource& tokens, ParserState& state) :
+  tokens(tokens), state(state), arena(state.arena), token(0) { }
+
+bool DescentParser::fail() {
+  if (state.error.empty()) {
+    state.error = std::string("syntax error, unexpected ") + tokenName(token);
+  }
+  return false;
+}
+
+bool DescentParser::expect(int expected) {
+  if (token != expected) {
+    return fail();
+  }
+  advance();
+  return true;
+}
+
+/* program : module top_stmts */
+bool DescentParser::parse() {
+  advance();
+  if (!expect(TMODULE)) {
+    return false;
+  }
+  NIdentifier *ident = parseIdentifier();
+  if (ident == NULL) {
+    return false;
+  }
+  state.beginProgram(new (arena) NModule(*ident));
+
+  if (token == 0) {
+    return fail();
+  }
+  while (token != 0) {
+    NStatement *statement = parseStatement();
+    if (statement == NULL) {
+      return false;
+    }
+    state.addTopLevel(statement);
+  }
+  return true;
+}
+
+/* Statements up to, not including, the closing token */
+bool DescentParser::parseStatements(NBlock& block, int closing) {
+  while (token != closing) {
+    NStatement *statement = parseStatement();
+    if (statement == NULL) {
+      return false;
+    }
+    block.statements.push_back(statement);
+  }
+  return true;
+}
+
+NBlock *DescentParser::parseBlock() {
+  if (!expect(TLBRACE)) {
+    return NULL;
+  }
+  NBlock *block = new (arena) NBlock(arena);
+  if (!parseStatements(*block, TRBRACE) || !expect(TRBRACE)) {
+    return NULL;
+  }
+  return block;
+}
+
+NStatement *DescentParser::parseStatement() {
+  switch (token) {
+    case TLET:
+      return parseVariableDeclaration();
+    case TFUNC:
+      return parseFunctionDeclaration(true);
+    case TVISIBILITY:
+      advance();
+      if (token != TFUNC) {
+        fail();
+        return NULL;
+      }
+      return parseFunctionDeclaration(false);
+    case TRETURN: {
+      advance();
+      NExpression *expression = parseExpression(PREC_COMPARISON);
+      return expression ? new (arena) NReturnStatement(*expression) : NULL;
+    }
+    case TCOMMENT_BEG: {
+      llvm::StringRef text = arena.copyString(value.text.data, value.text.length);
+      advance();
+      return new (arena) NCommentStatement(text);
+    }
+    case TIF:
+      return parseIf();
+    case TWHILE:
+      return parseWhile();
+    case TFOR:
+      return parseFor();
+    case TFOREACH:
+      return parseForeach();
+    case TCASE: {
+      NMatch *match = parseMatch(true);
+      return match ? new (arena) NExpressionStatement(*match) : NULL;
+    }
+  }
+  NExpression *expression = parseExpression(PREC_COMPARISON);
+  return expression ? new (arena) NExpressionStatement(*expression) : NULL;
+}
+
+/* type_annotation : blank | TCOLON TIDENTIFIER */
+bool DescentParser::parseTypeAnnotation(ValueType& type) {
+  type = TYPE_UNKNOWN;
+  if (token != TCOLON) {
+    return true;
+  }
+  advance();
+  if (token != TIDENTIFIER) {
+    return fail();
+  }
+  type = typeNamed(value.symbol->name);
+  if (type == TYPE_UNKNOWN) {
+    state.error = "unknown type in annotation";
+    return false;
+  }
+  advance();
+  return true;
+}
+
+/* var_decl : TLET ident type_annotation
+            | TLET ident type_annotation TEQUAL expr */
+NStatement *DescentParser::parseVariableDeclaration() {
+  advance();
+  NIdentifier *ident = parseIdentifier();
+  ValueType annotation;
+  if (ident == NULL || !parseTypeAnnotation(annotation)) {
+    return NULL;
+  }
+  if (token != TEQUAL) {
+    return new (arena) NVariableDeclaration(*ident, annotation);
+  }
+  advance();
+  NExpression *expression = parseExpression(PREC_COMPARISON);
+  return expression ? new (arena) NVariableDeclaration(*ident, expression, annotation) : NULL;
+}
+
+/* func_decl : TFUNC ident TEQUAL TPIPE func_decl_args TPIPE type_annotation block
+   The arguments, like func_decl_args, may start with a comma. */
+NStatement *DescentParser::parseFunctionDeclaration(bool externalLinkage) {
+  advance();
+  NIdentifier *ident = parseIdentifier();
+  if (ident == NULL || !expect(TEQUAL) || !expect(TPIPE)) {
+    return NULL;
+  }
+
+  VariableList arguments(arena);
+  ValueType annotation;
+  if (token == TIDENTIFIER) {
+    NIdentifier *argument = parseIdentifier();
+    if (!parseTypeAnnotation(annotation)) {
+      return NULL;
+    }
+    arguments.push_back(new (arena) NVariableDeclaration(*argument, annotation));
+  }
+  while (token == TCOMMA) {
+    advance();
+    NIdentifier *argument = parseIdentifier();
+    if (argument == NULL || !parseTypeAnnotation(annotation)) {
+      return NULL;
+    }
+    arguments.push_back(new (arena) NVariableDeclaration(*argument, annotation));
+  }
+  ValueType returnAnnotation;
+  if (!expect(TPIPE) || !parseTypeAnnotation(returnAnnotation)) {
+    return NULL;
+  }
+
+  NBlock *block = parseBlock();
+  if (block == NULL) {
+    return NULL;
+  }
+  return new (arena) NFunctionDeclaration(*ident, arguments, *block, externalLinkage, returnAnnotation);
+}
+
+/* if_stmt : TIF expr block
+           | TIF expr block TELSE block
+           | TIF expr block TELSE if_stmt */
+NStatement *DescentParser::parseIf() {
+  advance();
+  NExpression *condition = parseExpression(PREC_COMPARISON);
+  NBlock *thenBlock = condition ? parseBlock() : NULL;
+  if (thenBlock == NULL) {
+    return NULL;
+  }
+  if (token != TELSE) {
+    return new (arena) NIfStatement(*condition, *thenBlock);
+  }
+  advance();
+  NBlock *elseBlock;
+  if (token == TIF) {
+    NStatement *elseIf = parseIf();
+    if (elseIf == NULL) {
+      return NULL;
+    }
+    elseBlock = new (arena) NBlock(arena);
+    elseBlock->statements.push_back(elseIf);
+  } else {
+    elseBlock = parseBlock();
+    if (elseBlock == NULL) {
+      return NULL;
+    }
+  }
+  return new (arena) NIfStatement(*condition, *thenBlock, elseBlock);
+}
+
+/* TWHILE expr block */
+NStatement *DescentParser::parseWhile() {
+  advance();
+  NExpression *condition = parseExpression(PREC_COMPARISON);
+  NBlock *block = condition ? parseBlock() : NULL;
+  return block ? new (arena) NWhileStatement(*condition, *block) : NULL;
+}
+
+/* TFOR TLPAREN for_init TCOMMA expr TCOMMA expr TRPAREN block, where
+   for_init is a var_decl with an initializer */
+NStatement *DescentParser::parseFor() {
+  advance();
+  if (!expect(TLPAREN)) {
+    return NULL;
+  }
+  if (token != TLET) {
+    fail();
+    return NULL;
+  }
+  NVariableDeclaration *initializer = static_cast<NVariableDeclaration*>(parseVariableDeclaration());
+  if (initializer == NULL) {
+    return NULL;
+  }
+  if (initializer->assignmentExpr == NULL) {
+    fail();
+    return NULL;
+  }
+  if (!expect(TCOMMA)) {
+    return NULL;
+  }
+  NExpression *condition = parseExpression(PREC_COMPARISON);
+  if (condition == NULL || !expect(TCOMMA)) {
+    return NULL;
+  }
+  NExpression *step = parseExpression(PREC_COMPARISON);
+  if (step == NULL || !expect(TRPAREN)) {
+    return NULL;
+  }
+  NBlock *block = parseBlock();
+  return block ? new (arena) NForStatement(*initializer, *condition, *step, *block) : NULL;
+}
+
+/* TFOREACH ident TIN ident TLPAREN call_args TRPAREN block, where the
+   second ident is range and there are two or three call_args */
+NStatement *DescentParser::parseForeach() {
+  advance();
+  NIdentifier *ident = parseIdentifier();
+  if (ident == NULL || !expect(TIN)) {
+    return NULL;
+  }
+  if (token != TIDENTIFIER || value.symbol->name != "range") {
+    state.error = "foreach only iterates over range(from, to) or range(from, to, step)";
+    return NULL;
+  }
+  advance();
+  if (!expect(TLPAREN)) {
+    return NULL;
+  }
+  NExpression *bounds[3] = { NULL, NULL, NULL };
+  for (int i = 0; i < 3 && token != TRPAREN; i++) {
+    if (i > 0 && !expect(TCOMMA)) {
+      return NULL;
+    }
+    bounds[i] = parseExpression(PREC_COMPARISON);
+    if (bounds[i] == NULL) {
+      return NULL;
+    }
+  }
+  if (bounds[1] == NULL) {
+    state.error = "foreach only iterates over range(from, to) or range(from, to, step)";
+    return NULL;
+  }
+  NBlock *block = expect(TRPAREN) ? parseBlock() : NULL;
+  return block ? new (arena) NForeachStatement(*ident, *bounds[0], *bounds[1], bounds[2], *block) : NULL;
+}
+
+/* TCASE TLBRACE case_whens [TOTHERWISE block] TRBRACE, where case_whens
+   are TWHEN expr block, or
+   TMATCH TLBRACE match_whens TOTHERWISE expr TRBRACE, where match_whens
+   are TWHEN expr TTHEN expr */
+NMatch *DescentParser::parseMatch(bool isCase) {
+  advance();
+  if (!expect(TLBRACE)) {
+    return NULL;
+  }
+  NMatch *match = new (arena) NMatch(arena, isCase);
+  do {
+    if (!expect(TWHEN)) {
+      return NULL;
+    }
+    NExpression *condition = parseExpression(PREC_COMPARISON);
+    if (condition == NULL || (!isCase && !expect(TTHEN))) {
+      return NULL;
+    }
+    NExpression *arm = isCase ? parseBlock() : parseExpression(PREC_COMPARISON);
+    if (arm == NULL) {
+      return NULL;
+    }
+    match->conditions.push_back(condition);
+    match->arms.push_back(arm);
+  } while (token == TWHEN);
+
+  if (token == TOTHERWISE || !isCase) {
+    if (!expect(TOTHERWISE)) {
+      return NULL;
+    }
+    match->otherwise = isCase ? parseBlock() : parseExpression(PREC_COMPARISON);
+    if (match->otherwise == NULL) {
+      return NULL;
+    }
+  }
+  return expect(TRBRACE) ? match : NULL;
+}
+
+NIdentifier *DescentParser::parseIdentifier() {
+  if (token != TIDENTIFIER) {
+    fail();
+    return NULL;
+  }
+  NIdentifier *ident = new (arena) NIdentifier(value.symbol);
+  advance();
+  return ident;
+}
+
+/* Precedence climbing over the binary operators: operands are parsed one
+   level tighter than the operator, which makes every level left
+   associative; comparisons are then refused to chain. */
+NExpression *DescentParser::parseExpression(int precedence) {
+  NExpression *lhs = parsePrimary();
+  while (lhs != NULL && precedenceOf(token) >= precedence) {
+    int op = token;
+    int level = precedenceOf(op);
+    advance();
+    NExpression *rhs = parseExpression(level + 1);
+    if (rhs == NULL) {
+      return NULL;
+    }
+    lhs = new (arena) NBinaryOperator(*lhs, op, *rhs);
+    if (level == PREC_COMPARISON && precedenceOf(token) == PREC_COMPARISON) {
+      fail();
+      return NULL;
+    }
+  }
+  return lhs;
+}
+
+NExpression *DescentParser::parsePrimary() {
+  switch (token) {
+    case TIDENTIFIER: {
+      NIdentifier *ident = parseIdentifier();
+      if (token == TEQUAL) {
+        advance();
+        NExpression *rhs = parseExpression(PREC_COMPARISON);
+        return rhs ? new (arena) NAssignment(*ident, *rhs) : NULL;
+      }
+      if (token != TLPAREN) {
+        return ident;
+      }
+      /* call_args, which like the grammar may start with a comma */
+      advance();
+      ExpressionList arguments(arena);
+      if (token != TRPAREN && token != TCOMMA) {
+        NExpression *argument = parseExpression(PREC_COMPARISON);
+        if (argument == NULL) {
+          return NULL;
+        }
+        arguments.push_back(argument);
+      }
+      while (token == TCOMMA) {
+        advance();
+        NExpression *argument = parseExpression(PREC_COMPARISON);
+        if (argument == NULL) {
+          return NULL;
+        }
+        arguments.push_back(argument);
+      }
+      if (!expect(TRPAREN)) {
+        return NULL;
+      }
+      return new (arena) NMethodCall(*ident, arguments);
+    }
+    case TSTRING:
+      advance();
+      return new (arena) NString("BLAH ");
+    case TINTEGER: {
+      NExpression *integer = new (arena) NInteger(sliceToInteger(value.text));
+      advance();
+      return integer;
+    }
+    case TDOUBLE: {
+      NExpression *number = new (arena) NDouble(sliceToDouble(value.text));
+      advance();
+      return number;
+    }
+    case TLPAREN: {
+      advance();
+      NExpression *expression = parseExpression(PREC_COMPARISON);
+      if (expression == NULL || !expect(TRPAREN)) {
+        return NULL;
+      }
+      return expression;
+    }
+    case TMATCH:
+      return parseMatch(false);
+  }
+  fail();
+  return NULL;
+}
@@ -0,0 +1,582 @@
+#include <algorithm>
+#include <cstring>
+#include "src/includes/flat-ast.hpp"
+#include "src/includes/codegen.hpp"
+#include "build/parser.hpp"
+
+uint32_t FlatAst::add(FlatKind kind, uint32_t a, uint32_t b, uint32_t c)
+{
+  FlatNode node;
+  node.kind = kind;
+  node.flags = 0;
+  node.op = 0;
+  node.a = a;
+  node.b = b;
+  node.c = c;
+  nodes.push_back(node);
+  return nodes.size() - 1;
+}
+
+uint32_t FlatAst::addText(llvm::StringRef value)
+{
+  uint32_t offset = text.size();
+  text.insert(text.end(), value.begin(), value.end());
+  return offset;
+}
+
+uint32_t FlatAst::addNumber(FlatKind kind, uint64_t bits)
+{
+  return add(kind, (uint32_t)bits, (uint32_t)(bits >> 32));
+}
+
+uint32_t FlatAst::endList(size_t start)
+{
+  uint32_t first = children.size();
+  children.insert(children.end(), scratch.begin() + start, scratch.end());
+  scratch.resize(start);
+  return first;
+}
+
+void FlatAst::build(NModule& moduleNode, NBlock& rootBlock)
+{
+  module = moduleNode.flatten(*this);
+  root = rootBlock.flatten(*this);
+}
+
+size_t FlatAst::bytesUsed() const
+{
+  return nodes.size() * sizeof(FlatNode) + children.size() * sizeof(uint32_t) + text.size();
+}
+
+/* -- Flattening -- */
+
+uint32_t Node::flatten(FlatAst& ast)
+{
+  return FLAT_NONE;
+}
+
+uint32_t NString::flatten(FlatAst& ast)
+{
+  return ast.add(FLAT_STRING, ast.addText(value), value.size());
+}
+
+uint32_t NInteger::flatten(FlatAst& ast)
+{
+  return ast.addNumber(FLAT_INTEGER, (uint64_t)value);
+}
+
+uint32_t NDouble::flatten(FlatAst& ast)
+{
+  uint64_t bits;
+  memcpy(&bits, &value, sizeof(bits));
+  return ast.addNumber(FLAT_DOUBLE, bits);
+}
+
+uint32_t NIdentifier::flatten(FlatAst& ast)
+{
+  return ast.add(FLAT_IDENTIFIER, symbol->id);
+}
+
+/* Calls, operators and assignments nest as deep as the program writes
+   them, so they are flattened from a work stack rather than by
+   recursing. As in generateExpression, each is on the stack twice:
+   first to push its operands, then to be added once their indices are
+   on the index stack, which keeps the nodes in the order recursion
+   would add them. Any other operand is flattened by its own flatten. */
+struct FlattenFrame {
+  NExpression *node;
+  bool expanded; /* its operands are flattened */
+};
+
+static uint32_t flattenOperations(NExpression& root, FlatAst& ast)
+{
+  std::vector<FlattenFrame> work;
+  std::vector<uint32_t> indices;
+  FlattenFrame first = { &root, false };
+  work.push_back(first);
+
+  while (!work.empty()) {
+    FlattenFrame frame = work.back();
+    work.pop_back();
+    FlattenFrame operand = { NULL, false };
+
+    if (NMethodCall *node = dynamic_cast<NMethodCall*>(frame.node)) {
+      size_t count = node->arguments.size();
+      if (!frame.expanded) {
+        frame.expanded = true;
+        work.push_back(frame);
+        for (size_t i = count; i > 0; i--) {
+          operand.node = node->arguments[i - 1];
+          work.push_back(operand);
+        }
+        continue;
+      }
+      size_t start = ast.beginList();
+      for (size_t i = indices.size() - count; i < indices.size(); i++) {
+        ast.addToList(indices[i]);
+      }
+      indices.resize(indices.size() - count);
+      indices.push_back(ast.add(FLAT_METHOD_CALL, node->id.symbol->id, ast.endList(start), count));
+    }
+    else if (NBinaryOperator *node = dynamic_cast<NBinaryOperator*>(frame.node)) {
+      if (!frame.expanded) {
+        frame.expanded = true;
+        work.push_back(frame);
+        operand.node = node->rhs;
+        work.push_back(operand);
+        operand.node = node->lhs;
+        work.push_back(operand);
+        continue;
+      }
+      uint32_t right = indices.back();
+      indices.pop_back();
+      uint32_t left = indices.back();
+      indices.pop_back();
+      uint32_t index = ast.add(FLAT_BINARY_OPERATOR, left, right);
+      ast.nodes[index].op = node->op;
+      ast.nodes[index].flags = node->type;
+      indices.push_back(index);
+    }
+    else if (NAssignment *node = dynamic_cast<NAssignment*>(frame.node)) {
+      if (!frame.expanded) {
+        frame.expanded = true;
+        work.push_back(frame);
+        operand.node = node->rhs;
+        work.push_back(operand);
+        continue;
+      }
+      uint32_t value = indices.back();
+      indices.pop_back();
+      indices.push_back(ast.add(FLAT_ASSIGNMENT, node->lhs.symbol->id, value));
+    }
+    else {
+      indices.push_back(frame.node->flatten(ast));
+    }
+  }
+  return indices.back();
+}
+
+uint32_t NMethodCall::flatten(FlatAst& ast)
+{
+  return flattenOperations(*this, ast);
+}
+
+uint32_t NBinaryOperator::flatten(FlatAst& ast)
+{
+  return flattenOperations(*this, ast);
+}
+
+uint32_t NAssignment::flatten(FlatAst& ast)
+{
+  return flattenOperations(*this, ast);
+}
+
+uint32_t NBlock::flatten(FlatAst& ast)
+{
+  size_t start = ast.beginList();
+  StatementList::const_iterator it;
+  for (it = statements.begin(); it != statements.end(); it++) {
+    ast.addToList((**it).flatten(ast));
+  }
+  return ast.add(FLAT_BLOCK, 0, ast.endList(start), statements.size());
+}
+
+uint32_t NExpressionStatement::flatten(FlatAst& ast)
+{
+  return ast.add(FLAT_EXPRESSION_STATEMENT, expression->flatten(ast));
+}
+
+uint32_t NReturnStatement::flatten(FlatAst& ast)
+{
+  return ast.add(FLAT_RETURN_STATEMENT, expression->flatten(ast));
+}
+
+uint32_t NCommentStatement::flatten(FlatAst& ast)
+{
+  return ast.add(FLAT_COMMENT_STATEMENT, ast.addText(comment), comment.size());
+}
+
+uint32_t NVariableDeclaration::flatten(FlatAst& ast)
+{
+  uint32_t initializer = assignmentExpr != NULL ? assignmentExpr->flatten(ast) : FLAT_NONE;
+  uint32_t index = ast.add(FLAT_VARIABLE_DECLARATION, id.symbol->id, initializer, annotation);
+  ast.nodes[index].flags = id.type;
+  return index;
+}
+
+uint32_t NFunctionDeclaration::flatten(FlatAst& ast)
+{
+  uint32_t body = block.flatten(ast);
+  size_t start = ast.beginList();
+  ast.addToList(body);
+  VariableList::const_iterator it;
+  for (it = arguments.begin(); it != arguments.end(); it++) {
+    ast.addToList((**it).id.symbol->id);
+  }
+  for (it = arguments.begin(); it != arguments.end(); it++) {
+    ast.addToList((**it).annotation);
+  }
+  uint32_t index = ast.add(FLAT_FUNCTION_DECLARATION, id.symbol->id, ast.endList(start), arguments.size());
+  ast.nodes[index].flags = externalLinkage;
+  ast.nodes[index].op = returnAnnotation;
+  return index;
+}
+
+uint32_t NIfStatement::flatten(FlatAst& ast)
+{
+  uint32_t test = condition->flatten(ast);
+  uint32_t then = thenBlock.flatten(ast);
+  uint32_t otherwise = elseBlock != NULL ? elseBlock->flatten(ast) : FLAT_NONE;
+  return ast.add(FLAT_IF_STATEMENT, test, then, otherwise);
+}
+
+uint32_t NWhileStatement::flatten(FlatAst& ast)
+{
+  uint32_t test = condition->flatten(ast);
+  return ast.add(FLAT_WHILE_STATEMENT, test, block.flatten(ast));
+}
+
+uint32_t NForStatement::flatten(FlatAst& ast)
+{
+  uint32_t init = initializer.flatten(ast);
+  uint32_t test = condition->flatten(ast);
+  uint32_t next = step->flatten(ast);
+  uint32_t body = block.flatten(ast);
+  size_t start = ast.beginList();
+  ast.addToList(test);
+  ast.addToList(next);
+  return ast.add(FLAT_FOR_STATEMENT, init, body, ast.endList(start));
+}
+
+uint32_t NForeachStatement::flatten(FlatAst& ast)
+{
+  uint32_t first = from->flatten(ast);
+  uint32_t last = to->flatten(ast);
+  uint32_t increment = step != NULL ? step->flatten(ast) : FLAT_NONE;
+  uint32_t body = block.flatten(ast);
+  size_t start = ast.beginList();
+  ast.addToList(first);
+  ast.addToList(last);
+  ast.addToList(increment);
+  return ast.add(FLAT_FOREACH_STATEMENT, id.symbol->id, body, ast.endList(start));
+}
+
+uint32_t NMatch::flatten(FlatAst& ast)
+{
+  size_t start = ast.beginList();
+  for (size_t i = 0; i < conditions.size(); i++) {
+    uint32_t condition = conditions[i]->flatten(ast);
+    uint32_t arm = arms[i]->flatten(ast);
+    ast.addToList(condition);
+    ast.addToList(arm);
+  }
+  uint32_t last = otherwise != NULL ? otherwise->flatten(ast) : FLAT_NONE;
+  uint32_t index = ast.add(FLAT_MATCH, last, ast.endList(start), conditions.size());
+  ast.nodes[index].flags = type;
+  ast.nodes[index].op = isCase;
+  return index;
+}
+
+uint32_t NModule::flatten(FlatAst& ast)
+{
+  return ast.add(FLAT_MODULE, ident.symbol->id);
+}
+
+/* -- Code Generation --
+   Same IR as the codeGen methods of the tree, through the same
+   CodeGenContext helpers. */
+
+/* An argument without an annotation is dynamic */
+static std::vector<ValueType> argumentTypesOf(const FlatAst& ast, const FlatNode& node)
+{
+  std::vector<ValueType> types;
+  types.reserve(node.c);
+  for (uint32_t i = 0; i < node.c; i++) {
+    uint32_t annotation = ast.children[node.b + 1 + node.c + i];
+    types.push_back(annotation != TYPE_UNKNOWN ? (ValueType)annotation : TYPE_DYNAMIC);
+  }
+  return types;
+}
+
+/* As keyOf in codegen.cpp: the key of a `subject == key` condition */
+static Constant *keyOf(CodeGenContext& context, const FlatAst& ast, uint32_t condition, uint32_t& subject)
+{
+  const FlatNode& comparison = ast[condition];
+  if (comparison.kind != FLAT_BINARY_OPERATOR || comparison.op != TCEQ) {
+    return NULL;
+  }
+  uint32_t ident = comparison.a, key = comparison.b;
+  if (ast[ident].kind != FLAT_IDENTIFIER) {
+    std::swap(ident, key);
+  }
+  if (ast[ident].kind != FLAT_IDENTIFIER || (subject != FLAT_NONE && ast[ident].a != subject)) {
+    return NULL;
+  }
+  subject = ast[ident].a;
+  uint64_t bits = ast.bitsOf(ast[key]);
+  if (ast[key].kind == FLAT_INTEGER) {
+    return ConstantInt::get(context.types.llvmTypeOf(TYPE_INT), (long long)bits, true);
+  }
+  if (ast[key].kind == FLAT_DOUBLE) {
+    double value;
+    memcpy(&value, &bits, sizeof(value));
+    return ConstantFP::get(context.types.llvmTypeOf(TYPE_DOUBLE), value);
+  }
+  return NULL;
+}
+
+static Value *generateMatch(CodeGenContext& context, const FlatAst& ast, const FlatNode& node);
+
+static Value *generate(CodeGenContext& context, const FlatAst& ast, uint32_t index)
+{
+  const FlatNode& node = ast[index];
+  const SymbolTable& symbols = context.symbols;
+
+  switch (node.kind) {
+    case FLAT_STRING:
+      return ConstantDataArray::getString(getGlobalContext(), ast.textOf(node), false);
+
+    case FLAT_INTEGER:
+      return ConstantInt::get(context.types.llvmTypeOf(TYPE_INT), (long long)ast.bitsOf(node), true);
+
+    case FLAT_DOUBLE: {
+      uint64_t bits = ast.bitsOf(node);
+      double value;
+      memcpy(&value, &bits, sizeof(value));
+      return ConstantFP::get(context.types.llvmTypeOf(TYPE_DOUBLE), value);
+    }
+
+    case FLAT_IDENTIFIER:
+      return context.loadLocal(symbols[node.a]);
+
+    case FLAT_METHOD_CALL:
+    case FLAT_BINARY_OPERATOR:
+    case FLAT_ASSIGNMENT:
+      return context.generateExpression(ast, index);
+
+    case FLAT_BLOCK: {
+      Value *last = NULL;
+      context.pushScope();
+      for (uint32_t i = 0; i < node.c; i++) {
+        last = generate(context, ast, ast.children[node.b + i]);
+      }
+      context.popScope();
+      return last;
+    }
+
+    case FLAT_EXPRESSION_STATEMENT:
+      return generate(context, ast, node.a);
+
+    case FLAT_RETURN_STATEMENT: {
+      Value *returnValue = generate(context, ast, node.a);
+      context.createReturn(returnValue);
+      return returnValue;
+    }
+
+    case FLAT_COMMENT_STATEMENT:
+      return NULL;
+
+    case FLAT_IF_STATEMENT:
+      context.beginIf(generate(context, ast, node.a), node.c != FLAT_NONE);
+      generate(context, ast, node.b);
+      if (node.c != FLAT_NONE) {
+        context.beginElse();
+        generate(context, ast, node.c);
+      }
+      context.endIf();
+      return NULL;
+
+    case FLAT_WHILE_STATEMENT:
+      context.beginLoop();
+      context.beginLoopBody(generate(context, ast, node.a));
+      generate(context, ast, node.b);
+      context.endLoop();
+      return NULL;
+
+    case FLAT_FOR_STATEMENT:
+      context.pushScope();
+      generate(context, ast, node.a);
+      context.beginLoop();
+      context.beginLoopBody(generate(context, ast, ast.children[node.c]));
+      generate(context, ast, node.b);
+      context.beginLoopStep();
+      generate(context, ast, ast.children[node.c + 1]);
+      context.endLoop();
+      context.popScope();
+      return NULL;
+
+    case FLAT_VARIABLE_DECLARATION:
+      context.declareLocal(symbols[node.a], node.c != TYPE_UNKNOWN ? (ValueType)node.c : (ValueType)node.flags);
+      if (node.b != FLAT_NONE) {
+        context.storeLocal(symbols[node.a], generate(context, ast, node.b));
+      }
+      return NULL;
+
+    case FLAT_FUNCTION_DECLARATION: {
+      std::vector<const Symbol*> arguments;
+      arguments.reserve(node.c);
+      for (uint32_t i = 0; i < node.c; i++) {
+        arguments.push_back(symbols[ast.children[node.b + 1 + i]]);
+      }
+      Function *function = context.beginFunction(symbols[node.a], arguments, argumentTypesOf(ast, node),
+                                                 (ValueType)node.op, node.flags != 0);
+      generate(context, ast, ast.children[node.b]);
+      context.endFunction();
+      return function;
+    }
+
+    case FLAT_FOREACH_STATEMENT: {
+      Value *first = generate(context, ast, ast.children[node.c]);
+      Value *last = generate(context, ast, ast.children[node.c + 1]);
+      uint32_t increment = ast.children[node.c + 2];
+      context.beginRange(symbols[node.a], first, last,
+                         increment != FLAT_NONE ? generate(context, ast, increment) : NULL);
+      generate(context, ast, node.b);
+      context.endRange(symbols[node.a]);
+      return NULL;
+    }
+
+    case FLAT_MATCH:
+      return generateMatch(context, ast, node);
+
+    case FLAT_MODULE:
+      return ConstantInt::get(Type::getInt64Ty(getGlobalContext()), 42, true);
+  }
+  return NULL;
+}
+
+static Value *generateMatch(CodeGenContext& context, const FlatAst& ast, const FlatNode& node)
+{
+  uint32_t subject = FLAT_NONE;
+  std::vector<Constant*> keys;
+  for (uint32_t i = 0; i < node.c; i++) {
+    Constant *key = keyOf(context, ast, ast.children[node.b + 2 * i], subject);
+    if (key == NULL) {
+      break;
+    }
+    keys.push_back(key);
+  }
+  context.beginMatch((ValueType)node.flags, node.op == 0);
+  Value *value = keys.size() == node.c ? context.loadLocal(context.symbols[subject]) : NULL;
+  if (value != NULL) {
+    context.dispatch(value, keys);
+  }
+  for (uint32_t i = 0; i < node.c; i++) {
+    context.beginWhen(value != NULL ? NULL : generate(context, ast, ast.children[node.b + 2 * i]));
+    context.endWhen(generate(context, ast, ast.children[node.b + 2 * i + 1]));
+  }
+  context.beginOtherwise();
+  return context.endMatch(node.a != FLAT_NONE ? generate(context, ast, node.a) : NULL);
+}
+
+/* As the tree's: calls, operators and assignments go through a work
+   stack, where each is visited once to push its operands and once to
+   combine their values */
+struct FlatFrame {
+  uint32_t index;
+  bool expanded; /* its operands are generated */
+};
+
+Value* CodeGenContext::generateExpression(const FlatAst& ast, uint32_t index)
+{
+  SmallVector<FlatFrame, 32> work;
+  SmallVector<Value*, 32> values;
+  FlatFrame first = { index, false };
+  work.push_back(first);
+
+  while (!work.empty()) {
+    FlatFrame frame = work.pop_back_val();
+    const FlatNode& node = ast[frame.index];
+    FlatFrame operand = { FLAT_NONE, false };
+
+    if (node.kind == FLAT_METHOD_CALL) {
+      if (!frame.expanded) {
+        frame.expanded = true;
+        work.push_back(frame);
+        for (uint32_t i = node.c; i > 0; i--) {
+          operand.index = ast.children[node.b + i - 1];
+          work.push_back(operand);
+        }
+        continue;
+      }
+      /* the flat AST skips the resolver, which checks this on the tree */
+      Function *callee = lookupFunction(symbols[node.a]);
+      if (callee->arg_size() != node.c) {
+        std::cerr << "[ERR]" << symbols[node.a]->name.str() << " takes " << callee->arg_size()
+                  << " argument(s), not " << node.c << std::endl;
+        exit(-1);
+      }
+      std::vector<Value*> args(values.end() - node.c, values.end());
+      values.resize(values.size() - node.c);
+      values.push_back(createCall(callee, args));
+    }
+    else if (node.kind == FLAT_BINARY_OPERATOR) {
+      if (!frame.expanded) {
+        frame.expanded = true;
+        work.push_back(frame);
+        operand.index = node.b;
+        work.push_back(operand);
+        operand.index = node.a;
+        work.push_back(operand);
+        continue;
+      }
+      Value *right = values.pop_back_val();
+      Value *left = values.pop_back_val();
+      values.push_back(createBinaryOperator(node.op, left, right, (ValueType)node.flags));
+    }
+    else if (node.kind == FLAT_ASSIGNMENT) {
+      if (!frame.expanded) {
+        frame.expanded = true;
+        work.push_back(frame);
+        operand.index = node.b;
+        work.push_back(operand);
+        continue;
+      }
+      Value *value = values.pop_back_val();
+      values.push_back(storeLocal(symbols[node.a], value));
+    }
+    else {
+      values.push_back(generate(*this, ast, frame.index));
+    }
+  }
+  return values.back();
+}
+
+/* A let of the top level block initialized with a literal */
+static bool isModuleConstant(const FlatAst& ast, const FlatNode& node)
+{
+  return node.kind == FLAT_VARIABLE_DECLARATION && node.b != FLAT_NONE
+      && (ast[node.b].kind == FLAT_INTEGER || ast[node.b].kind == FLAT_DOUBLE);
+}
+
+void CodeGenContext::generateCode(const FlatAst& ast)
+{
+  std::cerr << "Starting code generation from the flat AST..." << std::endl;
+  /* Functions are all declared first, so that calls may come before
+     the callee's declaration */
+  for (size_t i = 0; i < ast.nodes.size(); i++) {
+    const FlatNode& node = ast.nodes[i];
+    if (node.kind == FLAT_FUNCTION_DECLARATION) {
+      declareFunction(symbols[node.a], argumentTypesOf(ast, node), (ValueType)node.op, node.flags != 0);
+    }
+  }
+  /* and so are the constants of the module, as with the tree */
+  const FlatNode& root = ast[ast.root];
+  for (uint32_t i = 0; i < root.c; i++) {
+    const FlatNode& node = ast[ast.children[root.b + i]];
+    if (isModuleConstant(ast, node)) {
+      declareConstant(symbols[node.a], (ValueType)node.c, cast<Constant>(generate(*this, ast, node.b)));
+    }
+  }
+  beginEntryPoint();
+  pushScope();
+  for (uint32_t i = 0; i < root.c; i++) {
+    uint32_t index = ast.children[root.b + i];
+    if (!isModuleConstant(ast, ast[index])) {
+      generate(*this, ast, index);
+    }
+  }
+  popScope();
+  endEntryPoint(symbols[ast[ast.module].a]->name);
+  std::cerr << "Code generation is done." << std::endl;
+}
@@ -1,37 +1,113 @@
 #include "src/includes/version.hpp"
 #include "src/includes/golo-llvm.hpp"
 #include "src/includes/codegen.hpp"
-
-extern int yyparse(void);
-extern FILE *yyin;
-extern NBlock* programBlock;
-extern NModule* topLevelModule;
+#include "src/includes/source-buffer.hpp"
+#include "src/includes/parser-state.hpp"
+#include "src/includes/flat-ast.hpp"
+#include "src/includes/ast-cache.hpp"
+#include "src/includes/streaming-codegen.hpp"
+#include "src/includes/ast-pass.hpp"
+#include "src/includes/const-fold.hpp"
+#include "src/includes/type-inference.hpp"
+#include <unistd.h>
+#include <sys/resource.h>
 
 void createCoreFunctions(CodeGenContext& context);
 void parseOptions(int, char**);
 
 char *outputFileName = NULL;
 char *inputFileName  = NULL;
+ParseOptions frontEndOptions;
+CodeGenOptions codeGenOptions;
+AstPassManager astPasses;
+bool flatCodeGen = false;
+bool useAstCache = true;
+bool streaming = false;
+
+/* Parses the whole program, then generates code for it */
+static void compileProgram(SourceBuffer& source) {
+  /* An unchanged file is not parsed again, see ast-cache.hpp */
+  ParserState state;
+  std::string cachePath = inputFileName && useAstCache ? astCachePath(inputFileName) : "";
+  if (!cachePath.empty() && loadAstCache(cachePath.c_str(), source, state)) {
+    std::cerr << "AST loaded from " << cachePath << std::endl;
+  } else {
+    if (!parseSource(source, state, frontEndOptions)) {
+      printf("Error: %s\n", state.error.c_str());
+      exit(1);
+    }
+    if (!cachePath.empty() && !writeAstCache(cachePath.c_str(), source, state)) {
+      std::cerr << "Unable to write " << cachePath << std::endl;
+    }
+  }
+
+  /* After caching: the cache holds the program as written */
+  astPasses.run(*state.programBlock, state.arena);
+  astPasses.report(std::cerr);
+
+  std::cerr << "Program block is " << state.programBlock << std::endl;
+  std::cerr << "AST arena: " << state.arena.bytesAllocated() << " bytes used, "
+            << state.arena.bytesReserved() << " bytes in " << state.arena.chunkCount() << " chunk(s)" << std::endl;
+  CodeGenContext context(state.topLevelModule->ident.name.str(), state.symbols, codeGenOptions);
+  createCoreFunctions(context);
+  if (flatCodeGen) {
+    /* Only the flat copy is kept through code generation */
+    FlatAst flat;
+    flat.build(*state.topLevelModule, *state.programBlock);
+    state.releaseTree();
+    std::cerr << "Flat AST: " << flat.nodes.size() << " nodes, " << flat.bytesUsed() << " bytes used" << std::endl;
+    context.generateCode(flat);
+  } else {
+    context.generateCode(*state.topLevelModule, *state.programBlock);
+  }
+  //context.runCode();
+  context.printModule(outputFileName);
+}
+
+/* Generates code for each top level function while parsing, see
+   streaming-codegen.hpp. The whole AST never exists, so there is no
+   AST cache and no flat AST in this mode. */
+static void compileStreaming(SourceBuffer& source) {
+  ParserState state;
+  StreamingCodeGen stream(state.symbols, state.arena, astPasses, outputFileName, codeGenOptions);
+  state.sink = &stream;
+  if (!parseSource(source, state, frontEndOptions)) {
+    printf("Error: %s\n", state.error.c_str());
+    exit(1);
+  }
+  std::cerr << "AST arena: " << state.arena.bytesAllocated() << " bytes used, "
+            << state.arena.bytesReserved() << " bytes in " << state.arena.chunkCount() << " chunk(s)" << std::endl;
+  stream.finish(*state.topLevelModule, *state.programBlock);
+  astPasses.report(std::cerr);
+}
 
 GoloLLVM::GoloLLVM(int argc, char **argv) {
+  /* In the order they run */
+  astPasses.add(new ConstantFolder());
+  astPasses.add(new TypeInference());
+
   parseOptions(argc, argv);
 
-  if(!inputFileName) {
-    yyin = stdin;
-  } else {
-    yyin = fopen(inputFileName,"r");
+  /* Source files are mmapped and scanned in place; stdin is slurped */
+  SourceBuffer source;
+  bool loaded = inputFileName ? source.open(inputFileName) : source.read(stdin);
+  if (!loaded) {
+    fprintf(stderr, "Unable to read %s.\n", inputFileName ? inputFileName : "stdin");
+    exit(1);
   }
-  yyparse();
-  fclose(yyin);
 
-  std::cerr << "Program block is " << programBlock << std::endl;
   // see http://comments.gmane.org/gmane.comp.compilers.llvm.devel/33877
   InitializeNativeTarget();
-  CodeGenContext context(topLevelModule->ident.name);
-  createCoreFunctions(context);
-  context.generateCode(*topLevelModule, *programBlock);
-  //context.runCode();
-  context.printModule(outputFileName);
+  if (streaming) {
+    compileStreaming(source);
+  } else {
+    compileProgram(source);
+  }
+
+  struct rusage usage;
+  if (getrusage(RUSAGE_SELF, &usage) == 0) {
+    std::cerr << "Peak RSS: " << usage.ru_maxrss << " KiB" << std::endl;
+  }
 }
 
 void parseOptions(int argc, char **argv) {
@@ -40,7 +116,7 @@ void parseOptions(int argc, char **argv) {
 
   opterr = 0;
 
-  while ((option = getopt (argc, argv, "c:o:")) != -1)
+  while ((option = getopt (argc, argv, "c:o:l:p:t:O:P:FNs")) != -1)
     switch(option)
     {
       case 'c':
@@ -49,9 +125,67 @@ void parseOptions(int argc, char **argv) {
       case 'o':
         outputFileName = optarg;
         break;
+      case 'l':
+        if (strcmp(optarg, "flex") == 0) {
+          frontEndOptions.lexer = LEXER_FLEX;
+        } else if (strcmp(optarg, "simd") == 0) {
+          frontEndOptions.lexer = LEXER_SIMD;
+        } else {
+          fprintf (stderr, "Unknown lexer `%s' (expected flex or simd).\n", optarg);
+          exit(1);
+        }
+        break;
+      case 'p':
+        if (strcmp(optarg, "bison") == 0) {
+          frontEndOptions.parser = PARSER_BISON;
+        } else if (strcmp(optarg, "descent") == 0) {
+          frontEndOptions.parser = PARSER_DESCENT;
+        } else {
+          fprintf (stderr, "Unknown parser `%s' (expected bison or descent).\n", optarg);
+          exit(1);
+        }
+        break;
+      case 't':
+        /* size in MiB from which lexing runs on its own thread */
+        frontEndOptions.pipelineThreshold = (size_t)atol(optarg) << 20;
+        break;
+      case 'O':
+        /* -O0 to -O3, or -Os which is -O2 favoring size */
+        if (strcmp(optarg, "s") == 0) {
+          codeGenOptions.optLevel = 2;
+          codeGenOptions.sizeLevel = 1;
+        } else if (strlen(optarg) == 1 && optarg[0] >= '0' && optarg[0] <= '3') {
+          codeGenOptions.optLevel = optarg[0] - '0';
+          codeGenOptions.sizeLevel = 0;
+        } else {
+          fprintf (stderr, "Unknown optimization level `-O%s' (expected 0, 1, 2, 3 or s).\n", optarg);
+          exit(1);
+        }
+        break;
+      case 'P':
+        /* -P <pass> enables an AST pass, -P no-<pass> disables it */
+        if (strncmp(optarg, "no-", 3) == 0 ? !astPasses.enable(optarg + 3, false) : !astPasses.enable(optarg, true)) {
+          fprintf (stderr, "Unknown AST pass `%s' (expected one of %s).\n", optarg, astPasses.names().c_str());
+          exit(1);
+        }
+        break;
+      case 'F':
+        flatCodeGen = true;
+        break;
+      case 's':
+        streaming = true;
+        break;
+      case 'N':
+        /* neither read nor write <input>.astc */
+        useAstCache = false;
+        break;
       case '?':
-        if ((optopt == 'c') || (optopt == 'o'))
+        if ((optopt == 'c') || (optopt == 'o') || (optopt == 'l') || (optopt == 'p') || (optopt == 't'))
           fprintf (stderr, "You must specify a file to the -%c option.\n", optopt);
+        else if (optopt == 'O')
+          fprintf (stderr, "You must specify a level to the -O option.\n");
+        else if (optopt == 'P')
+          fprintf (stderr, "You must specify a pass to the -P option.\n");
         else if (isprint (optopt))
           fprintf (stderr, "Unknown option `-%c'.\n", optopt);
         else
@@ -0,0 +1,136 @@
+#ifndef __ARENA__H
+#define __ARENA__H
+#include <cstddef>
+#include <cstring>
+#include <cassert>
+#include <llvm/ADT/StringRef.h>
+
+/* Bump allocator owning everything one compilation allocates for its AST:
+   nodes, argument lists and token text. Nothing allocated here is freed or
+   destroyed individually; the whole arena goes away in one shot, so objects
+   placed in it must not own heap memory of their own. */
+class Arena {
+  public:
+    Arena();
+    ~Arena();
+
+    void *allocate(size_t size, size_t alignment = sizeof(double));
+
+    template<class T>
+      T *allocateArray(size_t count) {
+        return static_cast<T*>(allocate(count * sizeof(T)));
+      }
+
+    /* Frees everything at once; the arena can be used again afterwards */
+    void reset();
+
+    /* A position in the arena. Rolling back to it frees everything
+       allocated since, and the arena carries on from there. */
+    struct Mark {
+      void *last;
+      char *current;
+      char *end;
+      size_t allocated;
+    };
+    Mark mark() const;
+    void rollback(const Mark& mark);
+
+    /* Copies the text and NUL-terminates it */
+    llvm::StringRef copyString(const char *data, size_t length);
+
+    size_t bytesAllocated() const { return allocated; }
+    size_t bytesReserved() const { return reserved; }
+    unsigned chunkCount() const { return chunks; }
+
+  private:
+    struct Chunk {
+      Chunk *previous;
+      size_t size;
+    };
+
+    char *current;
+    char *end;
+    Chunk *last;
+    Chunk *spare; /* a chunk freed by rollback, kept for reuse */
+    size_t allocated;
+    size_t reserved;
+    unsigned chunks;
+
+    void *allocateSlow(size_t size, size_t alignment);
+
+    Arena(const Arena&);
+    Arena& operator=(const Arena&);
+};
+
+inline void *operator new(size_t size, Arena& arena) {
+  return arena.allocate(size);
+}
+
+/* Only called if a constructor throws; the memory goes with the arena */
+inline void operator delete(void *, Arena&) { }
+
+/* Growable array of pointers (or other plain values) stored in an Arena.
+   Copies are shallow: they share the elements, which is what the parser
+   wants when it hands a list it built over to a node. */
+template<class T>
+class ArenaList {
+  public:
+    typedef T value_type;
+    typedef T* iterator;
+    typedef const T* const_iterator;
+    typedef size_t size_type;
+
+    ArenaList() : arena(NULL), items(NULL), count(0), capacity(0) { }
+    explicit ArenaList(Arena& arena) : arena(&arena), items(NULL), count(0), capacity(0) { }
+
+    void push_back(const T& item) {
+      if (count == capacity) {
+        grow();
+      }
+      items[count++] = item;
+    }
+
+    iterator begin() { return items; }
+    iterator end() { return items + count; }
+    const_iterator begin() const { return items; }
+    const_iterator end() const { return items + count; }
+
+    void reserve(size_t wanted) {
+      if (wanted > capacity) {
+        grow(wanted);
+      }
+    }
+
+    size_t size() const { return count; }
+    bool empty() const { return count == 0; }
+    T& operator[](size_t index) { return items[index]; }
+    const T& operator[](size_t index) const { return items[index]; }
+    T& back() { return items[count - 1]; }
+    /* Drops the elements from index on; their storage is not reused */
+    void truncate(size_t index) {
+      assert(index <= count);
+      count = index;
+    }
+
+  private:
+    Arena *arena;
+    T *items;
+    size_t count;
+    size_t capacity;
+
+    void grow() {
+      grow(capacity ? capacity * 2 : 4);
+    }
+
+    void grow(size_t grown) {
+      assert(arena != NULL && "list was not given an arena");
+      T *moved = arena->allocateArray<T>(grown);
+      if (count > 0) {
+        memcpy(moved, items, count * sizeof(T));
+      }
+      items = moved;
+      capacity = grown;
+    }
+};
+
+#endif
@@ -0,0 +1,55 @@
+#ifndef __AST_CACHE__H
+#define __AST_CACHE__H
+#include <string>
+#include <stdint.h>
+#include "src/includes/source-buffer.hpp"
+#include "src/includes/parser-state.hpp"
+
+/* Binary copy of a parse, written next to the source so that compiling
+   an unchanged file again skips lexing and parsing. The file is a
+   header followed by the arrays of the FlatAst and the names of the
+   symbol table, in native byte order:
+
+     header            AstCacheHeader, 64 bytes
+     nodes             nodeCount FlatNode
+     children          childCount uint32_t
+     symbol offsets    symbolCount + 1 uint32_t, into symbol names
+     symbol names      symbolBytes bytes
+     text              textBytes bytes
+
+   Loading maps the file, checks it, and rebuilds the tree in the
+   ParserState's arena straight from the mapping. Nodes are stored
+   children first, so one forward pass builds them all. */
+
+/* Bump whenever FlatNode, FlatKind or the token numbers change */
+static const uint32_t AST_CACHE_VERSION = 5;
+
+struct AstCacheHeader {
+  char magic[8];        /* "GOLOASTC" */
+  uint32_t version;
+  uint32_t nodeSize;    /* sizeof(FlatNode) */
+  uint64_t sourceLength;
+  uint64_t sourceHash;
+  uint32_t nodeCount;
+  uint32_t childCount;
+  uint32_t symbolCount;
+  uint32_t symbolBytes;
+  uint32_t textBytes;
+  uint32_t module;
+  uint32_t root;
+  uint32_t payloadHash; /* of everything after the header, so that a
+                           damaged file is refused */
+};
+
+/* Where the cache of a source file goes */
+std::string astCachePath(const char *sourceFileName);
+
+/* Writes the AST just parsed into state. The file is replaced
+   atomically, so concurrent compilations never see half of it. */
+bool writeAstCache(const char *path, const SourceBuffer& source, ParserState& state);
+
+/* Fills a freshly created state from the cache, if there is one and it
+   was made from this exact source; returns false otherwise. */
+bool loadAstCache(const char *path, const SourceBuffer& source, ParserState& state);
+
+#endif
@@ -0,0 +1,111 @@
+#ifndef __AST_PASS__H
+#define __AST_PASS__H
+#include <vector>
+#include <string>
+#include <ostream>
+#include <llvm/ADT/StringRef.h>
+#include "src/includes/node.h"
+
+/* Walks the tree through Node::accept. Each visit method walks the
+   children of its node by default; a visitor overrides the nodes it is
+   interested in and calls the default to keep walking below them.
+   Expressions return what replaces them in their parent, which is the
+   node itself unless the visitor rewrites it. Names that are written
+   (declarations, arguments, the left of an assignment) are not visited
+   as identifiers. Calls, operators and assignments nest as deep as the
+   program writes them, so they are walked from a work stack rather than
+   by recursing: a visitor overrides enter, called before the operands
+   of one of them are visited, and leave, called after, which returns
+   what replaces it. */
+class AstVisitor {
+  public:
+    virtual ~AstVisitor() { }
+
+    virtual NExpression *visit(NString& node) { return &node; }
+    virtual NExpression *visit(NInteger& node) { return &node; }
+    virtual NExpression *visit(NDouble& node) { return &node; }
+    virtual NExpression *visit(NIdentifier& node) { return &node; }
+    virtual NExpression *visit(NBlock& node);
+    virtual NExpression *visit(NMatch& node);
+    virtual NExpression *visit(NModule& node) { return &node; }
+
+    NExpression *visit(NMethodCall& node) { return walkOperations(node); }
+    NExpression *visit(NBinaryOperator& node) { return walkOperations(node); }
+    NExpression *visit(NAssignment& node) { return walkOperations(node); }
+    virtual void enter(NMethodCall& node) { }
+    virtual void enter(NBinaryOperator& node) { }
+    virtual void enter(NAssignment& node) { }
+    virtual NExpression *leave(NMethodCall& node) { return &node; }
+    virtual NExpression *leave(NBinaryOperator& node) { return &node; }
+    virtual NExpression *leave(NAssignment& node) { return &node; }
+
+    virtual void visit(NExpressionStatement& node);
+    virtual void visit(NReturnStatement& node);
+    virtual void visit(NCommentStatement& node) { }
+    virtual void visit(NVariableDeclaration& node);
+    virtual void visit(NFunctionDeclaration& node);
+    virtual void visit(NIfStatement& node);
+    virtual void visit(NWhileStatement& node);
+    virtual void visit(NForStatement& node);
+    virtual void visit(NForeachStatement& node);
+
+  private:
+    NExpression *walkOperations(NExpression& root);
+};
+
+/* An analysis or transformation of the tree, run between parsing and
+   code generation. Nodes a pass creates go in the arena of the tree. */
+class AstPass {
+  public:
+    virtual ~AstPass() { }
+
+    /* How the pass is named on the command line, see -P */
+    virtual const char *name() const = 0;
+    /* Runs on the top level block: the whole program, or in streaming
+       mode what is left of it once the functions are gone */
+    virtual void run(NBlock& root, Arena& arena) = 0;
+    /* Runs on one top level function, as soon as it is parsed in
+       streaming mode */
+    virtual void run(NFunctionDeclaration& function, Arena& arena) = 0;
+    /* Sees a let of the top level block before the functions that
+       follow it, in streaming mode where the block is run last */
+    virtual void declare(NVariableDeclaration& declaration, Arena& arena) { }
+    /* Appends what the pass did so far to its line of the report, as
+       ", <count> <what>" items */
+    virtual void report(std::ostream& out) const { }
+};
+
+/* Runs its passes in the order they were added, skipping the disabled
+   ones, and times each of them */
+class AstPassManager {
+  public:
+    AstPassManager() { }
+    ~AstPassManager();
+
+    /* Takes ownership of the pass */
+    void add(AstPass *pass, bool enabled = true);
+    /* Returns false if there is no pass of that name */
+    bool enable(llvm::StringRef name, bool enabled);
+
+    void run(NBlock& root, Arena& arena);
+    void run(NFunctionDeclaration& function, Arena& arena);
+    void declare(NVariableDeclaration& declaration, Arena& arena);
+
+    /* One line per pass: its name, the time spent in it and its report */
+    void report(std::ostream& out) const;
+    /* The names of all passes, for error messages */
+    std::string names() const;
+
+  private:
+    struct Entry {
+      AstPass *pass;
+      bool enabled;
+      double seconds; /* spent in all its runs */
+    };
+    std::vector<Entry> passes;
+
+    AstPassManager(const AstPassManager&);
+    AstPassManager& operator=(const AstPassManager&);
+};
+
+#endif
@@ -1,4 +1,6 @@
-#include <stack>
+#ifndef __CODEGEN__H
+#define __CODEGEN__H
+#include <vector>
 #include <typeinfo>
 #include <llvm/Module.h>
 #include <llvm/Function.h>
@@ -10,45 +12,205 @@
 #include <llvm/CallingConv.h>
 #include <llvm/Bitcode/ReaderWriter.h>
 #include <llvm/Analysis/Verifier.h>
+#include <llvm/Transforms/Scalar.h>
+#include <llvm/Transforms/IPO.h>
+#include <llvm/Transforms/IPO/PassManagerBuilder.h>
+#include <llvm/DataLayout.h>
 #include <llvm/Assembly/PrintModulePass.h>
 //#include <llvm/ModuleProvider.h>
 #include <llvm/Support/TargetSelect.h>
+#include <llvm/Target/TargetOptions.h>
 #include <llvm/ExecutionEngine/GenericValue.h>
 #include <llvm/ExecutionEngine/JIT.h>
 #include <llvm/Support/raw_ostream.h>
 #include "src/includes/node.h"
+#include "src/includes/symbol-table.hpp"
+#include "src/includes/scope-table.hpp"
+#include "src/includes/type-table.hpp"
 #include <llvm/ADT/StringMap.h>
+#include <llvm/ADT/DenseMap.h>
+#include <llvm/ADT/SmallPtrSet.h>
+#include <llvm/ADT/SmallVector.h>
 
 using namespace llvm;
 
 class NBlock;
 class NModule;
+class FlatAst;
 
+/* How hard the LLVM passes work on the module, as in -O<n> and -Os.
+   At level 0 the locals are still promoted to registers. */
+struct CodeGenOptions {
+  unsigned optLevel;  /* 0 to 3 */
+  unsigned sizeLevel; /* 1 for -Os */
+
+  CodeGenOptions() : optLevel(0), sizeLevel(0) { }
+};
+
+/* A function being generated; its locals are in the ScopeTable, their
+   slots at the top of its entry block */
 class CodeGenBlock {
 public:
     BasicBlock *block;
-    Value *returnValue;
-    std::map<std::string, Value*> locals;
+    BasicBlock *entry;
+    AllocaInst *lastAlloca;
+};
+
+/* An if or a loop being generated: where its branches go */
+struct ControlFlow {
+    BasicBlock *test;      /* of a loop: where each iteration starts */
+    BasicBlock *otherwise; /* of an if: its else, if it has one */
+    BasicBlock *end;
+};
+
+/* A foreach over a range being generated */
+struct RangeFlow {
+    Value *bound; /* the end of the range, as an i64 */
+    Value *step;  /* as an i64 */
+    /* With a constant step other than 1 or -1: the number of
+       iterations, and the slot counting up to it. NULL otherwise. */
+    Value *trips;
+    Value *position;
+};
+
+/* A case or a match being generated */
+struct MatchFlow {
+    std::vector<BasicBlock*> arms; /* once dispatched: the block of each arm */
+    size_t arm;                    /* the next of those to start */
+    BasicBlock *next;              /* the next condition, or the otherwise */
+    BasicBlock *end;
+    PHINode *value;                /* of a match, NULL for a case */
 };
 
 class CodeGenContext {
-    std::stack<CodeGenBlock *> blocks;
+    std::vector<CodeGenBlock> blocks;
+    std::vector<ControlFlow> controls;
+    std::vector<RangeFlow> ranges;
+    std::vector<MatchFlow> matches;
+    ScopeTable scopes;
     Function *mainFunction;
+    /* Once runCode made it, it owns the module */
+    ExecutionEngine *engine;
+    FunctionPassManager *functionPasses;
+    /* Called before their declaration was seen, and not defined since */
+    SmallPtrSet<Function*, 8> forwardCalls;
+    /* Taken out of the module by retireFunction, with their types */
+    DenseMap<const Symbol*, FunctionType*> retired;
+    /* Lets of the top level block initialized with a literal */
+    DenseMap<const Symbol*, GlobalVariable*> constants;
+    CodeGenOptions options;
 
 public:
+    /* Deleted with the context */
     Module *module;
-    CodeGenContext(std::string moduleName);
+    SymbolTable& symbols;
+    /* Golo functions of the module, by name */
+    DenseMap<const Symbol*, Function*> functions;
+    TypeTable types;
+    CodeGenContext(std::string moduleName, SymbolTable& symbols, const CodeGenOptions& options = CodeGenOptions());
+    ~CodeGenContext();
 
     void generateCode(NModule& module, NBlock& root);
+    void generateCode(const FlatAst& ast);
     GenericValue runCode();
-    std::map<std::string, Value*>& locals() { return blocks.top()->locals; }
-    BasicBlock *currentBlock() { return blocks.top()->block; }
-    void pushBlock(BasicBlock *block) { blocks.push(new CodeGenBlock()); blocks.top()->returnValue = NULL; blocks.top()->block = block; }
-    void popBlock() { CodeGenBlock *top = blocks.top(); blocks.pop(); delete top; }
-    void setCurrentReturnValue(Value *value) { blocks.top()->returnValue = value; }
-    Value* getCurrentReturnValue() { return blocks.top()->returnValue; }
+    BasicBlock *currentBlock() { return blocks.back().block; }
+    void pushBlock(BasicBlock *block) {
+      CodeGenBlock function = { block, block, NULL };
+      blocks.push_back(function);
+      scopes.pushFunction();
+    }
+    void popBlock() { scopes.pop(); blocks.pop_back(); }
+    /* Lexical scopes within the current function */
+    void pushScope() { scopes.pushScope(); }
+    void popScope() { scopes.pop(); }
     void printModule(std::string outputFileName);
+    /* Runs the function passes of the level on a finished function;
+       they at least turn its locals into registers */
+    void optimizeFunction(Function& function);
+
+    /* Emission helpers shared by both ASTs' code generators */
+    void beginEntryPoint();
+    void endEntryPoint(StringRef moduleName);
+    Value *declareLocal(const Symbol *symbol, ValueType type = TYPE_DYNAMIC);
+    Value *loadLocal(const Symbol *symbol);
+    Value *storeLocal(const Symbol *symbol, Value *value);
+    /* A constant of the module: an internal global that is never
+       written, whose value every function reads as an immediate where
+       no local hides it. Its type is the annotation, the value's own
+       without one. A later one of the same name replaces it. */
+    void declareConstant(const Symbol *symbol, ValueType type, Constant *value);
+    Function *lookupFunction(const Symbol *symbol);
+    /* The prototype of a function the program declares, created before
+       any code so that calls can refer to it */
+    Function *declareFunction(const Symbol *symbol, const std::vector<ValueType>& argumentTypes,
+                              ValueType returnType, bool externalLinkage);
+    /* The function a call refers to, declared by the call if it is not
+       known yet */
+    Function *callFunction(const Symbol *symbol, unsigned arity);
+    /* Drops a function whose code is written out and which nothing in
+       the module calls any more. A later call declares it again, with
+       the same type; it cannot be defined again. */
+    void retireFunction(const Symbol *symbol);
+    bool isRetired(const Symbol *symbol) const { return retired.count(symbol) != 0; }
+    Value *createCall(Function *function, const std::vector<Value*>& args);
+    Value *convert(Value *value, Type *type);
+    Value *createBinaryOperator(int op, Value *lhs, Value *rhs, ValueType type);
+    /* An expression of either AST, without recursing into its operands */
+    Value *generateExpression(NExpression& root, int depth);
+    Value *generateExpression(const FlatAst& ast, uint32_t index);
+    Function *beginFunction(const Symbol *symbol, const std::vector<const Symbol*>& arguments,
+                            const std::vector<ValueType>& argumentTypes, ValueType returnType,
+                            bool externalLinkage);
+    void endFunction();
+    /* Returns from the current function. What follows, which is never
+       run, goes in a block of its own. */
+    void createReturn(Value *value);
+
+    /* Structured control flow, emitted as
+         if:    beginIf, then block, [beginElse, else block,] endIf
+         loops: beginLoop, condition, beginLoopBody, body,
+                [beginLoopStep, step,] endLoop
+         foreach over a range: bounds, beginRange, body, endRange
+       Blocks are placed at the end of the function as they start, so
+       they come in source order, and locals stay in their slots, which
+       mem2reg turns into phis where the branches meet. */
+    void beginIf(Value *condition, bool hasElse);
+    void beginElse();
+    void endIf();
+    void beginLoop();
+    void beginLoopBody(Value *condition);
+    void beginLoopStep();
+    void endLoop();
+    void beginRange(const Symbol *counter, Value *from, Value *to, Value *step);
+    void endRange(const Symbol *counter);
+
+    /* case and match, emitted as
+         beginMatch, [dispatch,] then for each arm: [condition,]
+         beginWhen, arm, endWhen; then beginOtherwise, [otherwise,]
+         endMatch
+       Without dispatch the conditions are tested in order. With it,
+       each condition compares subject with the key of its arm, and the
+       arms are reached through a switch on integer keys, or a balanced
+       decision tree on floating point ones; beginWhen then gets NULL. */
+    void beginMatch(ValueType type, bool hasValue);
+    void dispatch(Value *subject, const std::vector<Constant*>& keys);
+    void beginWhen(Value *condition);
+    void endWhen(Value *value);
+    void beginOtherwise();
+    Value *endMatch(Value *value);
 
 private:
+    Function *findFunction(const Symbol *symbol);
+    /* A slot at the top of the entry block, with no name bound to it */
+    AllocaInst *createSlot(Type *type, StringRef name);
+    Function *createPrototype(const Symbol *symbol, const std::vector<ValueType>& argumentTypes,
+                              ValueType returnType, GlobalValue::LinkageTypes linkage);
+    Value *createComparison(int op, Value *lhs, Value *rhs);
+    void createDecisionTree(Value *subject, const std::vector<std::pair<double, BasicBlock*> >& keys,
+                            size_t begin, size_t end, BasicBlock *otherwise);
+    void startBlock(BasicBlock *block);
+    void populatePasses(PassManagerBuilder& builder);
     void runPasses();
 };
+
+#endif
@@ -0,0 +1,55 @@
+#ifndef __CONST_FOLD__H
+#define __CONST_FOLD__H
+#include <llvm/ADT/DenseMap.h>
+#include "src/includes/ast-pass.hpp"
+
+/* Constant folding on the tree, before code generation. Arithmetic on
+   integer or double literals is replaced by its result, and reads of a
+   `let` initialized with a literal and never assigned are replaced by
+   the literal. Such a let is then dropped with its declaration when no
+   read of it is left in its function. A let of the top level block is a
+   constant of the module: it is propagated into the functions that do
+   not bind its name themselves, and kept while any of them reads it. */
+class ConstantFolder : public AstPass, private AstVisitor {
+  public:
+    ConstantFolder() : folded(0), propagated(0), removed(0), eliminated(0),
+      arena(NULL), locals(NULL) { }
+
+    virtual const char *name() const { return "constant-fold"; }
+    virtual void run(NBlock& root, Arena& arena);
+    virtual void run(NFunctionDeclaration& function, Arena& arena);
+    virtual void declare(NVariableDeclaration& declaration, Arena& arena);
+    virtual void report(std::ostream& out) const;
+
+    unsigned folded;     /* operations replaced by their result */
+    unsigned propagated; /* reads replaced by the value of a let */
+    unsigned removed;    /* declarations dropped */
+    unsigned eliminated; /* nodes fewer in the tree */
+
+  private:
+    /* A local of the function being folded */
+    struct Local {
+      NExpression *value; /* the literal it holds, if known */
+      bool assigned;      /* appears on the left of an assignment */
+      bool bound;         /* declared or an argument, so no constant */
+      unsigned reads;     /* reads not replaced */
+      Local() : value(NULL), assigned(false), bound(false), reads(0) { }
+    };
+    typedef llvm::DenseMap<const Symbol*, Local> LocalMap;
+
+    void foldFunction(NBlock& body, const VariableList *arguments);
+    NExpression *copyLiteral(NExpression *literal);
+    void removeDeadLets(NBlock& body);
+
+    virtual NExpression *visit(NIdentifier& node);
+    virtual NExpression *leave(NBinaryOperator& node);
+    virtual void visit(NVariableDeclaration& node);
+    virtual void visit(NFunctionDeclaration& node);
+    using AstVisitor::visit;
+
+    Arena *arena;     /* of the tree being folded */
+    LocalMap *locals; /* of the function being folded */
+    LocalMap constants; /* of the module, read from its functions */
+};
+
+#endif
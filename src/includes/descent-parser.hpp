@@ -0,0 +1,43 @@
+#ifndef __DESCENT_PARSER__H
+#define __DESCENT_PARSER__H
+#include "src/includes/lexer.hpp"
+#include "src/includes/parser-state.hpp"
+
+/* Hand-written alternative to the bison grammar in parser.y. Statements
+   are parsed by recursive descent, expressions by precedence climbing,
+   and the AST built is the same one the grammar builds. Lists are
+   collected in locals and handed over to the node that keeps them, so
+   no intermediate list objects are allocated. */
+class DescentParser {
+  public:
+    DescentParser(TokenSource& tokens, ParserState& state);
+    bool parse();
+
+  private:
+    TokenSource& tokens;
+    ParserState& state;
+    Arena& arena;
+    int token; /* lookahead */
+    YYSTYPE value;
+
+    void advance() { token = tokens.next(&value); }
+    bool expect(int expected);
+    bool fail();
+
+    bool parseStatements(NBlock& block, int closing);
+    NBlock *parseBlock();
+    NStatement *parseStatement();
+    bool parseTypeAnnotation(ValueType& type);
+    NStatement *parseVariableDeclaration();
+    NStatement *parseFunctionDeclaration(bool externalLinkage);
+    NStatement *parseIf();
+    NStatement *parseWhile();
+    NStatement *parseFor();
+    NStatement *parseForeach();
+    NMatch *parseMatch(bool isCase);
+    NIdentifier *parseIdentifier();
+    NExpression *parseExpression(int precedence);
+    NExpression *parsePrimary();
+};
+
+#endif
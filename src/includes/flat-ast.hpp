@@ -0,0 +1,124 @@
+#ifndef __FLAT_AST__H
+#define __FLAT_AST__H
+#include <vector>
+#include <stdint.h>
+#include <llvm/ADT/StringRef.h>
+#include "src/includes/node.h"
+
+/* Node kinds of the flat AST, one per Node class */
+enum FlatKind {
+  FLAT_STRING,
+  FLAT_INTEGER,
+  FLAT_DOUBLE,
+  FLAT_IDENTIFIER,
+  FLAT_METHOD_CALL,
+  FLAT_BINARY_OPERATOR,
+  FLAT_ASSIGNMENT,
+  FLAT_BLOCK,
+  FLAT_EXPRESSION_STATEMENT,
+  FLAT_RETURN_STATEMENT,
+  FLAT_COMMENT_STATEMENT,
+  FLAT_VARIABLE_DECLARATION,
+  FLAT_FUNCTION_DECLARATION,
+  FLAT_MODULE,
+  FLAT_IF_STATEMENT,
+  FLAT_WHILE_STATEMENT,
+  FLAT_FOR_STATEMENT,
+  FLAT_MATCH,
+  FLAT_FOREACH_STATEMENT
+};
+
+/* Marks an absent child, such as a declaration without initializer */
+static const uint32_t FLAT_NONE = 0xffffffffu;
+
+/* One node in 16 bytes. What a, b and c hold depends on the kind:
+
+     STRING, COMMENT_STATEMENT   a = offset in text, b = length
+     INTEGER, DOUBLE             a, b = low, high word of the value
+     IDENTIFIER, MODULE          a = symbol id
+     METHOD_CALL                 a = callee symbol id, b = first argument
+                                 in children, c = argument count
+     BINARY_OPERATOR             op = token, flags = ValueType, a = lhs,
+                                 b = rhs
+     ASSIGNMENT                  a = symbol id, b = rhs
+     BLOCK                       b = first statement in children, c = count
+     EXPRESSION_STATEMENT,
+     RETURN_STATEMENT            a = expression
+     VARIABLE_DECLARATION        flags = ValueType, a = symbol id,
+                                 b = initializer or FLAT_NONE,
+                                 c = annotation
+     FUNCTION_DECLARATION        flags = external linkage, op = return
+                                 annotation, a = symbol id,
+                                 children[b] = body, children[b + 1 ..]
+                                 = c argument symbol ids, then their c
+                                 annotations
+     IF_STATEMENT                a = condition, b = then block, c = else
+                                 block or FLAT_NONE
+     WHILE_STATEMENT             a = condition, b = block
+     FOR_STATEMENT               a = initializer declaration, b = block,
+                                 children[c] = condition, children[c + 1]
+                                 = step
+     MATCH                       flags = ValueType, op = is a case,
+                                 a = otherwise or FLAT_NONE,
+                                 children[b + 2i], children[b + 2i + 1]
+                                 = condition, arm of the c whens
+     FOREACH_STATEMENT           a = counter symbol id, b = block,
+                                 children[c], children[c + 1],
+                                 children[c + 2] = from, to, step or
+                                 FLAT_NONE
+
+   Annotations are ValueTypes, TYPE_UNKNOWN where there is none.
+
+   Every other field is an index into nodes. */
+struct FlatNode {
+  uint8_t kind;
+  uint8_t flags;
+  uint16_t op;
+  uint32_t a;
+  uint32_t b;
+  uint32_t c;
+};
+
+/* Compact copy of the tree built by the parser: nodes sit in one array
+   and refer to each other by 32-bit index, child lists are runs of the
+   children array, and names are symbol ids into the compilation's
+   SymbolTable. Code generation walks it with a switch on the kind
+   (CodeGenContext::generateCode(const FlatAst&)) instead of virtual
+   calls, and it does not need the parser's arena once built. */
+class FlatAst {
+  public:
+    std::vector<FlatNode> nodes;
+    std::vector<uint32_t> children;
+    std::vector<char> text;
+    uint32_t module; /* the MODULE node */
+    uint32_t root;   /* the top level BLOCK */
+
+    FlatAst() : module(FLAT_NONE), root(FLAT_NONE) { }
+
+    void build(NModule& module, NBlock& root);
+
+    uint32_t add(FlatKind kind, uint32_t a = 0, uint32_t b = 0, uint32_t c = 0);
+    uint32_t addText(llvm::StringRef value);
+    uint32_t addNumber(FlatKind kind, uint64_t bits);
+
+    /* Child lists are collected on a scratch stack while their elements
+       are flattened, then moved to children in one run */
+    size_t beginList() const { return scratch.size(); }
+    void addToList(uint32_t index) { scratch.push_back(index); }
+    uint32_t endList(size_t start);
+
+    const FlatNode& operator[](uint32_t index) const { return nodes[index]; }
+    llvm::StringRef textOf(const FlatNode& node) const {
+      return node.b ? llvm::StringRef(&text[0] + node.a, node.b) : llvm::StringRef();
+    }
+    uint64_t bitsOf(const FlatNode& node) const {
+      return (uint64_t)node.b << 32 | node.a;
+    }
+
+    size_t bytesUsed() const;
+
+  private:
+    std::vector<uint32_t> scratch;
+};
+
+#endif
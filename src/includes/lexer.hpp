@@ -0,0 +1,50 @@
+#ifndef __LEXER__H
+#define __LEXER__H
+#include "src/includes/node.h"
+#include "build/parser.hpp"
+#include "src/includes/source-buffer.hpp"
+#include "src/includes/symbol-table.hpp"
+
+/* Anything the parser can pull tokens from */
+class TokenSource {
+  public:
+    virtual ~TokenSource() { }
+    /* Fills lval and returns the next token, 0 at the end of the input */
+    virtual int next(YYSTYPE *lval) = 0;
+};
+
+/* The flex scanner from tokens.l, running over a SourceBuffer */
+class FlexScanner : public TokenSource {
+  public:
+    FlexScanner(SourceBuffer& source, SymbolTable& symbols);
+    virtual ~FlexScanner();
+    virtual int next(YYSTYPE *lval);
+
+  private:
+    void *scanner;
+    void *buffer;
+};
+
+/* Hand-written lexer producing exactly the tokens of tokens.l. It scans
+   the buffer in place and uses SSE2 or AVX2, when the compiler targets
+   them (AVX2 takes SIMD=avx2 in the Makefile), to skip whitespace and find the end of identifiers, numbers and
+   comments a whole vector at a time. It relies on the NUL padding the
+   SourceBuffer puts after the text. */
+class Lexer : public TokenSource {
+  public:
+    Lexer(SourceBuffer& source, SymbolTable& symbols);
+    virtual int next(YYSTYPE *lval);
+
+  private:
+    const char *current;
+    const char *end;
+    SymbolTable& symbols;
+};
+
+TokenSource *createLexer(LexerKind kind, SourceBuffer& source, SymbolTable& symbols);
+
+/* Bytes the Lexer examines per vector step: 32 with AVX2, 16 with SSE2,
+   or 1 when it was built for neither. */
+unsigned lexerVectorWidth();
+
+#endif
@@ -1,125 +1,209 @@
 #ifndef __NODE__H
 #define __NODE__H
 #include <iostream>
-#include <vector>
+#include <stdint.h>
 #include <llvm/Value.h>
+#include <llvm/ADT/StringRef.h>
+#include "src/includes/arena.hpp"
+#include "src/includes/symbol-table.hpp"
 
+namespace llvm { class Function; }
 class CodeGenContext;
+class FlatAst;
+class AstVisitor;
 class NStatement;
 class NExpression;
 class NVariableDeclaration;
 
-typedef std::vector<NStatement*> StatementList;
-typedef std::vector<NExpression*> ExpressionList;
-typedef std::vector<NVariableDeclaration*> VariableList;
+typedef ArenaList<NStatement*> StatementList;
+typedef ArenaList<NExpression*> ExpressionList;
+typedef ArenaList<NVariableDeclaration*> VariableList;
 
+/* Nodes are allocated in the compilation's Arena and released with it,
+   without running destructors: they must not own heap memory. */
 class Node {
   public:
     virtual ~Node() {}
     virtual llvm::Value* codeGen(CodeGenContext& context, int depth) { return NULL; }
+    /* Appends the node to the flat AST and returns its index */
+    virtual uint32_t flatten(FlatAst& ast);
 };
 
+/* What is known of the values of an expression, see TypeInference.
+   The fixed-width ones only come from annotations, see typeNamed. */
+enum ValueType {
+  TYPE_DYNAMIC, /* not known statically: held in an i64 for now */
+  TYPE_INT,     /* i64 */
+  TYPE_DOUBLE,  /* double */
+  TYPE_UNKNOWN, /* no value reaches it yet, generated as dynamic; on a
+                   declaration, no annotation */
+  TYPE_I8,
+  TYPE_I16,
+  TYPE_I32,
+  TYPE_F32,
+  TYPE_BOOL,
+  TYPE_COUNT    /* of the above */
+};
+
+/* The type an annotation names, or TYPE_UNKNOWN */
+inline ValueType typeNamed(llvm::StringRef name) {
+  if (name == "i64") return TYPE_INT;
+  if (name == "f64") return TYPE_DOUBLE;
+  if (name == "i32") return TYPE_I32;
+  if (name == "i16") return TYPE_I16;
+  if (name == "i8") return TYPE_I8;
+  if (name == "f32") return TYPE_F32;
+  if (name == "bool") return TYPE_BOOL;
+  return TYPE_UNKNOWN;
+}
+
 class NExpression : public Node {
+  public:
+    ValueType type;
+    NExpression() : type(TYPE_DYNAMIC) { }
+    /* Calls the visitor's visit for the node's class, and returns what
+       replaces the node, see AstVisitor */
+    virtual NExpression *accept(AstVisitor& visitor) = 0;
 };
 
 class NStatement : public Node {
+  public:
+    virtual void accept(AstVisitor& visitor) = 0;
 };
 
 class NString : public NExpression {
   public:
-    std::string value;
-    NString(const std::string& value) : value(value) { }
+    llvm::StringRef value;
+    NString(llvm::StringRef value) : value(value) { }
     virtual llvm::Value* codeGen(CodeGenContext& context, int depth);
+    virtual uint32_t flatten(FlatAst& ast);
+    virtual NExpression *accept(AstVisitor& visitor);
 };
 
 class NInteger : public NExpression {
   public:
     long long value;
-    NInteger(long long value) : value(value) { };
+    NInteger(long long value) : value(value) { type = TYPE_INT; };
     virtual llvm::Value* codeGen(CodeGenContext& context, int depth);
+    virtual uint32_t flatten(FlatAst& ast);
+    virtual NExpression *accept(AstVisitor& visitor);
 };
 
 class NDouble : public NExpression {
   public:
     double value;
-    NDouble(double value) : value(value) { };
+    NDouble(double value) : value(value) { type = TYPE_DOUBLE; };
     virtual llvm::Value* codeGen(CodeGenContext& context, int depth);
+    virtual uint32_t flatten(FlatAst& ast);
+    virtual NExpression *accept(AstVisitor& visitor);
 };
 
 class NIdentifier : public NExpression {
   public:
-    std::string name;
-    NIdentifier(const std::string& name) : name(name) { }
+    const Symbol *symbol;
+    llvm::StringRef name;
+    NIdentifier(const Symbol *symbol) : symbol(symbol), name(symbol->name) { }
+    NIdentifier(llvm::StringRef name) : symbol(NULL), name(name) { }
     virtual llvm::Value* codeGen(CodeGenContext& context, int depth);
+    virtual uint32_t flatten(FlatAst& ast);
+    virtual NExpression *accept(AstVisitor& visitor);
 };
 
 class NMethodCall : public NExpression {
   public:
     const NIdentifier& id;
     ExpressionList arguments;
+    llvm::Function *callee; /* bound by FunctionResolver */
     NMethodCall(const NIdentifier& id, ExpressionList& arguments) :
-      id(id), arguments(arguments) { }
-    NMethodCall(const NIdentifier& id) : id(id) { }
+      id(id), arguments(arguments), callee(NULL) { }
+    NMethodCall(const NIdentifier& id) : id(id), callee(NULL) { }
     virtual llvm::Value* codeGen(CodeGenContext& context, int depth);
+    virtual uint32_t flatten(FlatAst& ast);
+    virtual NExpression *accept(AstVisitor& visitor);
 };
 
+/* Operands and other sub-expressions are held by pointer, so that
+   passes such as ConstantFolder can replace them */
 class NBinaryOperator : public NExpression {
   public:
     int op;
-    NExpression& lhs;
-    NExpression& rhs;
+    NExpression *lhs;
+    NExpression *rhs;
     NBinaryOperator(NExpression& lhs, int op, NExpression& rhs) :
-      lhs(lhs), rhs(rhs), op(op) { }
+      lhs(&lhs), rhs(&rhs), op(op) { }
     virtual llvm::Value* codeGen(CodeGenContext& context, int depth);
+    virtual uint32_t flatten(FlatAst& ast);
+    virtual NExpression *accept(AstVisitor& visitor);
 };
 
 class NAssignment : public NExpression {
   public:
     NIdentifier& lhs;
-    NExpression& rhs;
+    NExpression *rhs;
     NAssignment(NIdentifier& lhs, NExpression& rhs) : 
-      lhs(lhs), rhs(rhs) { }
+      lhs(lhs), rhs(&rhs) { }
     virtual llvm::Value* codeGen(CodeGenContext& context, int depth);
+    virtual uint32_t flatten(FlatAst& ast);
+    virtual NExpression *accept(AstVisitor& visitor);
 };
 
 class NBlock : public NExpression {
   public:
     StatementList statements;
     NBlock() { }
+    NBlock(Arena& arena) : statements(arena) { }
     virtual llvm::Value* codeGen(CodeGenContext& context, int depth);
+    virtual uint32_t flatten(FlatAst& ast);
+    virtual NExpression *accept(AstVisitor& visitor);
 };
 
 class NExpressionStatement : public NStatement {
   public:
-    NExpression& expression;
+    NExpression *expression;
     NExpressionStatement(NExpression& expression) : 
-      expression(expression) { }
+      expression(&expression) { }
     virtual llvm::Value* codeGen(CodeGenContext& context, int depth);
+    virtual uint32_t flatten(FlatAst& ast);
+    virtual void accept(AstVisitor& visitor);
 };
 
 class NReturnStatement : public NStatement {
   public:
-    NExpression& expression;
+    NExpression *expression;
     NReturnStatement(NExpression& expression) : 
-      expression(expression) { }
+      expression(&expression) { }
     virtual llvm::Value* codeGen(CodeGenContext& context, int depth);
+    virtual uint32_t flatten(FlatAst& ast);
+    virtual void accept(AstVisitor& visitor);
 };
 
 class NCommentStatement : public NStatement {
   public:
-    std::string& comment;
-    NCommentStatement(std::string& comment) : comment(comment) { }
+    llvm::StringRef comment;
+    NCommentStatement(llvm::StringRef comment) : comment(comment) { }
     virtual llvm::Value* codeGen(CodeGenContext& context, int depth);
+    virtual uint32_t flatten(FlatAst& ast);
+    virtual void accept(AstVisitor& visitor);
 };
 
 class NVariableDeclaration : public NStatement {
   public:
     NIdentifier& id;
     NExpression *assignmentExpr;
-    NVariableDeclaration(NIdentifier& id) : id(id) { }
-    NVariableDeclaration(NIdentifier& id, NExpression *assignmentExpr) :
-      id(id), assignmentExpr(assignmentExpr) { }
+    ValueType annotation; /* `name: type`, or TYPE_UNKNOWN */
+    NVariableDeclaration(NIdentifier& id, ValueType annotation = TYPE_UNKNOWN) :
+      id(id), assignmentExpr(NULL), annotation(annotation) { }
+    NVariableDeclaration(NIdentifier& id, NExpression *assignmentExpr, ValueType annotation = TYPE_UNKNOWN) :
+      id(id), assignmentExpr(assignmentExpr), annotation(annotation) { }
+    /* Initialized with an integer or double literal. In the top level
+       block, such a let is a constant of the module, which functions
+       see too and nothing may assign. */
+    bool hasLiteralValue() const {
+      return dynamic_cast<NInteger*>(assignmentExpr) != NULL || dynamic_cast<NDouble*>(assignmentExpr) != NULL;
+    }
     virtual llvm::Value* codeGen(CodeGenContext& context, int depth);
+    virtual uint32_t flatten(FlatAst& ast);
+    virtual void accept(AstVisitor& visitor);
 };
 
 class NFunctionDeclaration : public NStatement {
@@ -128,9 +212,87 @@ class NFunctionDeclaration : public NStatement {
     VariableList arguments;
     NBlock block;
     bool externalLinkage;
-    NFunctionDeclaration(const NIdentifier& id, const VariableList& arguments, NBlock& block, bool externalLinkage = true) :
-      id(id), arguments(arguments), block(block), externalLinkage(externalLinkage) { }
+    ValueType returnAnnotation; /* `|args|: type`, or TYPE_UNKNOWN */
+    NFunctionDeclaration(const NIdentifier& id, const VariableList& arguments, NBlock& block, bool externalLinkage = true,
+                         ValueType returnAnnotation = TYPE_UNKNOWN) :
+      id(id), arguments(arguments), block(block), externalLinkage(externalLinkage), returnAnnotation(returnAnnotation) { }
+    virtual llvm::Value* codeGen(CodeGenContext& context, int depth);
+    virtual uint32_t flatten(FlatAst& ast);
+    virtual void accept(AstVisitor& visitor);
+};
+
+/* An else if is an else block holding the next if */
+class NIfStatement : public NStatement {
+  public:
+    NExpression *condition;
+    NBlock& thenBlock;
+    NBlock *elseBlock; /* NULL without else */
+    NIfStatement(NExpression& condition, NBlock& thenBlock, NBlock *elseBlock = NULL) :
+      condition(&condition), thenBlock(thenBlock), elseBlock(elseBlock) { }
+    virtual llvm::Value* codeGen(CodeGenContext& context, int depth);
+    virtual uint32_t flatten(FlatAst& ast);
+    virtual void accept(AstVisitor& visitor);
+};
+
+class NWhileStatement : public NStatement {
+  public:
+    NExpression *condition;
+    NBlock& block;
+    NWhileStatement(NExpression& condition, NBlock& block) :
+      condition(&condition), block(block) { }
+    virtual llvm::Value* codeGen(CodeGenContext& context, int depth);
+    virtual uint32_t flatten(FlatAst& ast);
+    virtual void accept(AstVisitor& visitor);
+};
+
+/* for (let i = 0, i < n, i = i + 1) { }: the let is only visible in
+   the loop */
+class NForStatement : public NStatement {
+  public:
+    NVariableDeclaration& initializer;
+    NExpression *condition;
+    NExpression *step;
+    NBlock& block;
+    NForStatement(NVariableDeclaration& initializer, NExpression& condition, NExpression& step, NBlock& block) :
+      initializer(initializer), condition(&condition), step(&step), block(block) { }
+    virtual llvm::Value* codeGen(CodeGenContext& context, int depth);
+    virtual uint32_t flatten(FlatAst& ast);
+    virtual void accept(AstVisitor& visitor);
+};
+
+/* foreach i in range(from, to, step) { }: i counts from from up to, not
+   including, to, by step, or by 1 without one; it is only visible in
+   the loop. Ranges are all foreach iterates over, so the loop is a
+   counted one, with nothing allocated or called per step. */
+class NForeachStatement : public NStatement {
+  public:
+    NIdentifier& id;
+    NExpression *from;
+    NExpression *to;
+    NExpression *step; /* NULL without one */
+    NBlock& block;
+    NForeachStatement(NIdentifier& id, NExpression& from, NExpression& to, NExpression *step, NBlock& block) :
+      id(id), from(&from), to(&to), step(step), block(block) { }
+    virtual llvm::Value* codeGen(CodeGenContext& context, int depth);
+    virtual uint32_t flatten(FlatAst& ast);
+    virtual void accept(AstVisitor& visitor);
+};
+
+/* match { when c then e ... otherwise e } is the value of the first
+   arm whose condition holds. case { when c { } ... otherwise { } } runs
+   the block of that arm instead: it is an NMatch with blocks as arms,
+   no value and an optional otherwise, held by an NExpressionStatement. */
+class NMatch : public NExpression {
+  public:
+    ExpressionList conditions;
+    ExpressionList arms;
+    NExpression *otherwise; /* NULL without otherwise */
+    bool isCase;
+    NMatch(Arena& arena, bool isCase) :
+      conditions(arena), arms(arena), otherwise(NULL), isCase(isCase) { }
     virtual llvm::Value* codeGen(CodeGenContext& context, int depth);
+    virtual uint32_t flatten(FlatAst& ast);
+    virtual NExpression *accept(AstVisitor& visitor);
 };
 
 class NModule : public NExpression {
@@ -138,6 +300,8 @@ class NModule : public NExpression {
     const NIdentifier& ident;
     NModule(const NIdentifier& ident) : ident(ident) { };
     virtual llvm::Value* codeGen(CodeGenContext& context, int depth);
+    virtual uint32_t flatten(FlatAst& ast);
+    virtual NExpression *accept(AstVisitor& visitor);
 };
 
 #endif
@@ -0,0 +1,96 @@
+#ifndef __PARSER_STATE__H
+#define __PARSER_STATE__H
+#include <string>
+#include "src/includes/source-buffer.hpp"
+#include "src/includes/arena.hpp"
+#include "src/includes/symbol-table.hpp"
+
+class NBlock;
+class NModule;
+class NStatement;
+class NFunctionDeclaration;
+class NVariableDeclaration;
+class TokenSource;
+
+enum LexerKind {
+  LEXER_FLEX, /* the scanner generated from tokens.l */
+  LEXER_SIMD  /* the hand-written, vectorized one in lexer.cpp */
+};
+
+enum ParserKind {
+  PARSER_BISON,  /* the grammar in parser.y */
+  PARSER_DESCENT /* the hand-written one in descent-parser.cpp */
+};
+
+/* Inputs this big or bigger are lexed on a thread of their own, see
+   PipelinedLexer. Below it, starting the thread costs more than it
+   saves. */
+static const size_t DEFAULT_PIPELINE_THRESHOLD = 16 << 20;
+
+struct ParseOptions {
+  LexerKind lexer;
+  ParserKind parser;
+  size_t pipelineThreshold; /* in bytes; 0 always pipelines */
+
+  ParseOptions() : lexer(LEXER_SIMD), parser(PARSER_BISON),
+    pipelineThreshold(DEFAULT_PIPELINE_THRESHOLD) { }
+};
+
+/* Takes the top level functions as soon as they are parsed, for
+   compiling a program one function at a time. The declaration is freed
+   when function returns. */
+class TopLevelSink {
+  public:
+    virtual ~TopLevelSink() { }
+    virtual void module(NModule& module) = 0;
+    virtual void function(NFunctionDeclaration& declaration) = 0;
+    /* A top level let, seen before the functions after it; it stays in
+       the top level block */
+    virtual void variable(NVariableDeclaration& declaration) { }
+};
+
+/* Everything one parse produces. Lexer and parser keep no global state,
+   so several files can be parsed at once, one ParserState each.
+   The AST lives in the state's arena and goes away with it; identifiers
+   are interned in its symbol table, which code generation keeps using. */
+class ParserState {
+  public:
+    Arena arena;
+    SymbolTable symbols;
+    NBlock *programBlock; /* the top level root node of the AST */
+    NModule *topLevelModule; /* name of the llvm module */
+    std::string error;
+    TokenSource *tokens; /* where the parser reads from */
+    TopLevelSink *sink; /* if set, top level functions go there and are
+                           not kept in programBlock */
+
+    ParserState() : programBlock(NULL), topLevelModule(NULL), tokens(NULL), sink(NULL) { }
+
+    /* Called by the parsers once the module line is read, then with
+       each top level statement in turn */
+    void beginProgram(NModule *module);
+    void addTopLevel(NStatement *statement);
+
+    /* Frees the AST, keeping the symbols, once nothing refers to it */
+    void releaseTree() {
+      arena.reset();
+      programBlock = NULL;
+      topLevelModule = NULL;
+    }
+
+  private:
+    Arena::Mark topLevelMark; /* where the statement being parsed starts */
+
+    ParserState(const ParserState&);
+    ParserState& operator=(const ParserState&);
+};
+
+/* Parses everything the token source produces. Returns false on a
+   syntax error, in which case state.error holds the message. */
+bool parseTokens(TokenSource& tokens, ParserState& state, ParserKind parser = PARSER_BISON);
+
+/* Scans and parses the whole buffer with the lexer and parser chosen,
+   lexing on a separate thread when the buffer reaches the threshold */
+bool parseSource(SourceBuffer& source, ParserState& state, const ParseOptions& options = ParseOptions());
+
+#endif
@@ -0,0 +1,57 @@
+#ifndef __PIPELINED_LEXER__H
+#define __PIPELINED_LEXER__H
+#include <pthread.h>
+#include "src/includes/lexer.hpp"
+
+/* Runs another TokenSource on a thread of its own so that lexing
+   overlaps with parsing. Tokens go through a lock-free ring buffer with
+   one producer, the lexer thread, and one consumer, the parser; each
+   side only rereads the other's index when the ring looks full or
+   empty. The lexer only touches the SourceBuffer and the SymbolTable.
+   Nothing else may intern into the table until the parse is over, so
+   code generation running during the parse, in streaming mode, interns
+   the names it needs before the parse starts. */
+class PipelinedLexer : public TokenSource {
+  public:
+    /* Takes ownership of the lexer */
+    PipelinedLexer(TokenSource *lexer);
+    virtual ~PipelinedLexer();
+    virtual int next(YYSTYPE *lval);
+
+  private:
+    struct Token {
+      int token;
+      YYSTYPE value;
+    };
+
+    /* Slots in the ring, a power of two */
+    static const unsigned CAPACITY = 4096;
+
+    TokenSource *lexer;
+    Token *ring;
+    pthread_t thread;
+    bool threaded; /* false if the thread could not be started */
+    int stopped;   /* set when the parser gives up before the end */
+
+    /* Each index is written by one side only and kept a cache line
+       away from the other, next to that side's copy of the other index */
+    char separator[64];
+    struct {
+      unsigned head;
+      unsigned tail; /* last tail seen */
+    } producer;
+    char producerPadding[64];
+    struct {
+      unsigned tail;
+      unsigned head; /* last head seen */
+    } consumer;
+    char consumerPadding[64];
+
+    static void *run(void *self);
+    void produce();
+
+    PipelinedLexer(const PipelinedLexer&);
+    PipelinedLexer& operator=(const PipelinedLexer&);
+};
+
+#endif
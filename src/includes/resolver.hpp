@@ -0,0 +1,34 @@
+#ifndef __RESOLVER__H
+#define __RESOLVER__H
+#include "src/includes/ast-pass.hpp"
+
+class CodeGenContext;
+
+/* Binds every call of the tree to the llvm::Function it calls, so that
+   code generation neither looks callees up nor needs them generated
+   first. The prototypes of all the functions the tree declares are
+   created before any call is bound: a function may be called above its
+   declaration, and functions may call each other. */
+class FunctionResolver : private AstVisitor {
+  public:
+    FunctionResolver(CodeGenContext& context) : context(context), declaring(false), forward(false) { }
+
+    /* The whole program: calling a function it does not declare is an
+       error */
+    void resolve(NBlock& root);
+    /* One function of a program compiled as it is parsed: a function
+       not seen yet is declared by the first call to it, and must be
+       defined by the end of the program */
+    void resolve(NFunctionDeclaration& function);
+
+  private:
+    virtual void enter(NMethodCall& node);
+    virtual void visit(NFunctionDeclaration& node);
+    using AstVisitor::visit;
+
+    CodeGenContext& context;
+    bool declaring; /* first walk, which only creates prototypes */
+    bool forward;   /* calls may declare their callee */
+};
+
+#endif
@@ -0,0 +1,51 @@
+#ifndef __SCOPE_TABLE__H
+#define __SCOPE_TABLE__H
+#include <vector>
+#include <llvm/Value.h>
+#include "src/includes/symbol-table.hpp"
+
+/* The local variables of code generation, for all open scopes at once.
+   Bindings are pushed on one array and each records the binding of the
+   same symbol it shadows; the innermost binding of every symbol is found
+   by its id. Opening a scope only remembers where its bindings start,
+   and closing it unwinds them, so scopes allocate nothing once the
+   arrays have grown, and lookups cost the same however deep they are. */
+class ScopeTable {
+  public:
+    ScopeTable() { }
+
+    /* A function's scope: the names of enclosing scopes, which belong to
+       other functions, are not visible in it */
+    void pushFunction();
+    /* A scope nested in the current one, which sees its names */
+    void pushScope();
+    void pop();
+
+    /* The innermost visible binding of the symbol, or NULL */
+    llvm::Value *lookup(const Symbol *symbol) const;
+    /* Binds the symbol in the current scope, replacing any binding the
+       scope already had for it */
+    void bind(const Symbol *symbol, llvm::Value *value);
+
+  private:
+    static const unsigned NONE = ~0u;
+
+    struct Entry {
+      const Symbol *symbol;
+      llvm::Value *value;
+      unsigned shadowed; /* previous binding of the symbol, or NONE */
+    };
+    struct Scope {
+      unsigned first;   /* its first entry */
+      unsigned visible; /* first entry lookups may see */
+    };
+
+    std::vector<Entry> entries;
+    std::vector<Scope> scopes;
+    std::vector<unsigned> innermost; /* by symbol id, into entries */
+
+    ScopeTable(const ScopeTable&);
+    ScopeTable& operator=(const ScopeTable&);
+};
+
+#endif
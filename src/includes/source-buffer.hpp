@@ -0,0 +1,57 @@
+#ifndef __SOURCE_BUFFER__H
+#define __SOURCE_BUFFER__H
+#include <cstddef>
+#include <cstdio>
+#include <string>
+
+/* A piece of the source text handed from the lexer to the parser.
+   It points straight into the SourceBuffer (no copy, no NUL terminator)
+   and stays valid for as long as the buffer lives. Kept as a plain
+   struct so it can sit in the bison %union. */
+struct SourceSlice {
+  const char *data;
+  size_t length;
+
+  std::string str() const { return std::string(data, length); }
+};
+
+long long sliceToInteger(const SourceSlice& slice);
+double sliceToDouble(const SourceSlice& slice);
+
+/* Number of NUL bytes guaranteed after the text. flex's yy_scan_buffer
+   needs two; the rest lets vectorized scanners load a full register
+   past the last character without running off the buffer. */
+static const size_t SOURCE_PADDING = 64;
+
+/* The whole input, laid out the way flex's yy_scan_buffer wants it:
+   the text followed by SOURCE_PADDING NUL bytes. Regular files are
+   mmapped and scanned in place, anything else (pipes, stdin) is read
+   in one go. */
+class SourceBuffer {
+  public:
+    SourceBuffer();
+    ~SourceBuffer();
+
+    bool open(const char *fileName);
+    bool read(FILE *stream);
+
+    /* Buffer handed to the scanner, including the two trailing NULs */
+    char *scanBase() { return base; }
+    size_t scanSize() const { return length + 2; }
+
+    const char *data() const { return base; }
+    size_t size() const { return length; }
+    bool isMapped() const { return mapped; }
+
+  private:
+    char *base;
+    size_t length;
+    size_t capacity;
+    bool mapped;
+
+    void release();
+    SourceBuffer(const SourceBuffer&);
+    SourceBuffer& operator=(const SourceBuffer&);
+};
+
+#endif
@@ -0,0 +1,49 @@
+#ifndef __STREAMING_CODEGEN__H
+#define __STREAMING_CODEGEN__H
+#include <cstdio>
+#include <llvm/ADT/SmallPtrSet.h>
+#include "src/includes/codegen.hpp"
+#include "src/includes/parser-state.hpp"
+#include "src/includes/ast-pass.hpp"
+
+/* Compiles a program one top level function at a time, while it is
+   being parsed. Each function is generated as soon as the parser hands
+   it over, run through the AST passes, verified, optimized, written to
+   the output and reduced to a declaration, so neither its AST nor its
+   IR stays in memory. The declaration goes too once no function still
+   to be written calls it. What is left (the entry point, globals,
+   declarations of external functions) is written by finish once the
+   parse is over. As functions are gone by then, module passes such as
+   inlining only see the entry point. A function sees the constants of
+   the module declared above it. */
+class StreamingCodeGen : public TopLevelSink {
+  public:
+    StreamingCodeGen(SymbolTable& symbols, Arena& arena, AstPassManager& passes,
+                     const char *outputFileName, const CodeGenOptions& options = CodeGenOptions());
+    virtual ~StreamingCodeGen();
+
+    virtual void module(NModule& module);
+    virtual void function(NFunctionDeclaration& declaration);
+    virtual void variable(NVariableDeclaration& declaration);
+
+    /* Generates the entry point from the statements kept in root */
+    void finish(NModule& module, NBlock& root);
+
+    CodeGenContext *context; /* named after the module once it is parsed */
+
+  private:
+    void write(Function *function);
+    void retire();
+
+    SymbolTable& symbols;
+    Arena& arena; /* of the parse, for the AST passes */
+    AstPassManager& passes;
+    CodeGenOptions options;
+    FILE *file;
+    raw_fd_ostream *out;
+    Module *scratch; /* holds the function being written */
+    SmallPtrSet<Function*, 16> written; /* functions already output */
+    SmallPtrSet<Function*, 8> kept;     /* the ones createCoreFunctions made */
+};
+
+#endif
@@ -0,0 +1,38 @@
+#ifndef __SYMBOL_TABLE__H
+#define __SYMBOL_TABLE__H
+#include <vector>
+#include <llvm/ADT/StringRef.h>
+#include <llvm/ADT/StringMap.h>
+#include "src/includes/arena.hpp"
+
+/* One distinct name. Symbols are unique per table, so two names are
+   equal exactly when their Symbol pointers are, and id is a small dense
+   number usable as an array index. */
+class Symbol {
+  public:
+    llvm::StringRef name;
+    unsigned id;
+};
+
+/* Intern table shared by the lexer, the parser and code generation of
+   one compilation. The lexer hashes each identifier once; everything
+   after that compares and indexes Symbol handles. */
+class SymbolTable {
+  public:
+    SymbolTable() { }
+
+    const Symbol *intern(llvm::StringRef name);
+
+    unsigned size() const { return symbols.size(); }
+    const Symbol *operator[](unsigned id) const { return symbols[id]; }
+
+  private:
+    Arena storage;
+    llvm::StringMap<Symbol*> table;
+    std::vector<Symbol*> symbols;
+
+    SymbolTable(const SymbolTable&);
+    SymbolTable& operator=(const SymbolTable&);
+};
+
+#endif
@@ -0,0 +1,66 @@
+#ifndef __TYPE_INFERENCE__H
+#define __TYPE_INFERENCE__H
+#include <algorithm>
+#include <vector>
+#include <llvm/ADT/DenseMap.h>
+#include "src/includes/ast-pass.hpp"
+
+/* Gives every expression of a function a ValueType, so that numbers
+   whose type is known are generated as plain integer or floating point
+   values. An annotated local or argument has the type it is annotated
+   with. Any other local has the type of all the values assigned to it:
+   that type if they agree, a double if they are numbers and one is
+   floating point, dynamic otherwise; arguments are then dynamic. An
+   operation with a floating point operand is floating point, one on
+   two integers an integer, as wide as the widest operand; an integer
+   literal counts as wide as the other operand if it fits in it.
+   A call has the result type its function is annotated with, dynamic
+   without one. Each function is walked until the types of its locals
+   settle; the declaration of a local carries its type in its
+   identifier. A constant of the module, a let of the top level block
+   initialized with a literal, is seen by every function with the type
+   of its literal or annotation. */
+class TypeInference : public AstPass, private AstVisitor {
+  public:
+    TypeInference() : integers(0), floats(0), dynamics(0), locals(NULL), changed(false), nested(NULL) { }
+
+    virtual const char *name() const { return "type-inference"; }
+    virtual void run(NBlock& root, Arena& arena);
+    virtual void run(NFunctionDeclaration& function, Arena& arena);
+    virtual void declare(NVariableDeclaration& declaration, Arena& arena);
+    virtual void report(std::ostream& out) const;
+
+    /* locals of each kind, over all functions */
+    unsigned integers;
+    unsigned floats;
+    unsigned dynamics;
+
+  private:
+    struct Local {
+      ValueType type;
+      bool annotated; /* assignments do not change the type */
+    };
+    typedef llvm::DenseMap<const Symbol*, Local> LocalMap;
+
+    void inferFunction(NBlock& body, const VariableList *arguments);
+    void assign(const Symbol *symbol, ValueType type);
+    void annotate(const Symbol *symbol, ValueType type);
+
+    virtual NExpression *visit(NIdentifier& node);
+    virtual NExpression *leave(NMethodCall& node);
+    virtual NExpression *leave(NBinaryOperator& node);
+    virtual NExpression *leave(NAssignment& node);
+    virtual NExpression *visit(NMatch& node);
+    virtual void visit(NVariableDeclaration& node);
+    virtual void visit(NForeachStatement& node);
+    virtual void visit(NFunctionDeclaration& node);
+    using AstVisitor::visit;
+
+    LocalMap *locals; /* of the function being inferred */
+    bool changed;     /* a local got a new type in this walk */
+    std::vector<NFunctionDeclaration*> *nested; /* met in the function */
+    llvm::DenseMap<const Symbol*, ValueType> results; /* of the functions seen */
+    llvm::DenseMap<const Symbol*, ValueType> constants; /* of the module */
+};
+
+#endif
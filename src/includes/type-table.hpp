@@ -0,0 +1,36 @@
+#ifndef __TYPE_TABLE__H
+#define __TYPE_TABLE__H
+#include <llvm/Type.h>
+#include <llvm/LLVMContext.h>
+#include "src/includes/node.h"
+
+/* One type a value may have. Descriptors are unique per table, so two
+   types are equal exactly when their pointers are. Annotations name
+   them through typeNamed, in the parsers. */
+class TypeDescriptor {
+  public:
+    llvm::Type *llvmType;  /* how its values are generated */
+
+    bool isFloatingPoint() const { return llvmType->isFloatingPointTy(); }
+};
+
+/* The types of one code generation, each mapped to its LLVM type when
+   the table is made. Codegen asks for them by ValueType, which is an
+   array index; an unknown value is generated as a dynamic one. */
+class TypeTable {
+  public:
+    TypeTable(llvm::LLVMContext& context);
+
+    const TypeDescriptor *get(ValueType type) const {
+      return &descriptors[type == TYPE_UNKNOWN ? TYPE_DYNAMIC : type];
+    }
+    llvm::Type *llvmTypeOf(ValueType type) const { return get(type)->llvmType; }
+
+  private:
+    TypeDescriptor descriptors[TYPE_COUNT];
+
+    TypeTable(const TypeTable&);
+    TypeTable& operator=(const TypeTable&);
+};
+
+#endif
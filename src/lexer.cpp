@@ -0,0 +1,270 @@
+#include <cstdio>
+#include <cstring>
+#include "src/includes/lexer.hpp"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define LEXER_VECTOR 32
+typedef __m256i Vector;
+static inline Vector load(const char *p) { return _mm256_loadu_si256((const __m256i *)p); }
+static inline Vector splat(char c) { return _mm256_set1_epi8(c); }
+static inline Vector equal(Vector v, char c) { return _mm256_cmpeq_epi8(v, splat(c)); }
+static inline Vector either(Vector a, Vector b) { return _mm256_or_si256(a, b); }
+static inline Vector add(Vector v, char c) { return _mm256_add_epi8(v, splat(c)); }
+static inline Vector below(Vector v, char c) { return _mm256_cmpgt_epi8(splat(c), v); }
+static inline unsigned lanes(Vector v) { return (unsigned)_mm256_movemask_epi8(v); }
+static inline unsigned otherLanes(Vector v) { return ~lanes(v); }
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define LEXER_VECTOR 16
+typedef __m128i Vector;
+static inline Vector load(const char *p) { return _mm_loadu_si128((const __m128i *)p); }
+static inline Vector splat(char c) { return _mm_set1_epi8(c); }
+static inline Vector equal(Vector v, char c) { return _mm_cmpeq_epi8(v, splat(c)); }
+static inline Vector either(Vector a, Vector b) { return _mm_or_si128(a, b); }
+static inline Vector add(Vector v, char c) { return _mm_add_epi8(v, splat(c)); }
+static inline Vector below(Vector v, char c) { return _mm_cmplt_epi8(v, splat(c)); }
+static inline unsigned lanes(Vector v) { return (unsigned)_mm_movemask_epi8(v); }
+static inline unsigned otherLanes(Vector v) { return ~lanes(v) & 0xffffu; }
+#endif
+
+static inline bool isSpace(char c) { return c == ' ' || c == '\t' || c == '\n'; }
+static inline bool isDigit(char c) { return (unsigned char)(c - '0') < 10; }
+static inline bool isIdentStart(char c) { return (unsigned char)((c | 0x20) - 'a') < 26 || c == '_'; }
+static inline bool isIdentChar(char c) { return isIdentStart(c) || isDigit(c); }
+
+#ifdef LEXER_VECTOR
+/* Lanes holding a byte in [lo, hi]. SSE2/AVX2 only compare signed bytes,
+   so the range is first slid down to start at -128. */
+static inline Vector inRange(Vector v, char lo, char hi) {
+  return below(add(v, (char)(0x80 - lo)), (char)(-128 + (hi - lo + 1)));
+}
+
+static inline Vector spacesIn(Vector v) {
+  return either(either(equal(v, ' '), equal(v, '\t')), equal(v, '\n'));
+}
+
+static inline Vector digitsIn(Vector v) {
+  return inRange(v, '0', '9');
+}
+
+static inline Vector identCharsIn(Vector v) {
+  Vector letters = inRange(either(v, splat(0x20)), 'a', 'z');
+  return either(either(letters, digitsIn(v)), equal(v, '_'));
+}
+#endif
+
+/* Each of these returns the first byte at or after p that is not part of
+   the run. The NUL padding after the text ends every run. */
+
+static inline const char *skipSpaces(const char *p) {
+#ifdef LEXER_VECTOR
+  while (isSpace(*p)) {
+    unsigned rest = otherLanes(spacesIn(load(p)));
+    if (rest != 0) {
+      return p + __builtin_ctz(rest);
+    }
+    p += LEXER_VECTOR;
+  }
+  return p;
+#else
+  while (isSpace(*p)) p++;
+  return p;
+#endif
+}
+
+static inline const char *skipDigits(const char *p) {
+#ifdef LEXER_VECTOR
+  for (;;) {
+    unsigned rest = otherLanes(digitsIn(load(p)));
+    if (rest != 0) {
+      return p + __builtin_ctz(rest);
+    }
+    p += LEXER_VECTOR;
+  }
+#else
+  while (isDigit(*p)) p++;
+  return p;
+#endif
+}
+
+static inline const char *skipIdentifier(const char *p) {
+#ifdef LEXER_VECTOR
+  for (;;) {
+    unsigned rest = otherLanes(identCharsIn(load(p)));
+    if (rest != 0) {
+      return p + __builtin_ctz(rest);
+    }
+    p += LEXER_VECTOR;
+  }
+#else
+  while (isIdentChar(*p)) p++;
+  return p;
+#endif
+}
+
+static inline const char *findLineEnd(const char *p, const char *end) {
+#ifdef LEXER_VECTOR
+  while (p < end) {
+    Vector v = load(p);
+    unsigned stop = lanes(either(equal(v, '\n'), equal(v, '\0')));
+    if (stop != 0) {
+      const char *found = p + __builtin_ctz(stop);
+      return found < end ? found : end;
+    }
+    p += LEXER_VECTOR;
+  }
+  return end;
+#else
+  const char *found = (const char *)memchr(p, '\n', end - p);
+  return found ? found : end;
+#endif
+}
+
+static int keyword(const char *text, size_t length) {
+  switch (length) {
+    case 2:
+      if (memcmp(text, "if", 2) == 0) return TIF;
+      if (memcmp(text, "in", 2) == 0) return TIN;
+      break;
+    case 3:
+      if (memcmp(text, "let", 3) == 0) return TLET;
+      if (memcmp(text, "for", 3) == 0) return TFOR;
+      break;
+    case 4:
+      if (memcmp(text, "else", 4) == 0) return TELSE;
+      if (memcmp(text, "case", 4) == 0) return TCASE;
+      if (memcmp(text, "when", 4) == 0) return TWHEN;
+      if (memcmp(text, "then", 4) == 0) return TTHEN;
+      break;
+    case 5:
+      if (memcmp(text, "local", 5) == 0) return TVISIBILITY;
+      if (memcmp(text, "while", 5) == 0) return TWHILE;
+      if (memcmp(text, "match", 5) == 0) return TMATCH;
+      break;
+    case 6:
+      if (memcmp(text, "return", 6) == 0) return TRETURN;
+      if (memcmp(text, "module", 6) == 0) return TMODULE;
+      break;
+    case 8:
+      if (memcmp(text, "function", 8) == 0) return TFUNC;
+      break;
+    case 7:
+      if (memcmp(text, "foreach", 7) == 0) return TFOREACH;
+      break;
+    case 9:
+      if (memcmp(text, "otherwise", 9) == 0) return TOTHERWISE;
+      break;
+  }
+  return 0;
+}
+
+Lexer::Lexer(SourceBuffer& source, SymbolTable& symbols) :
+  current(source.data()), end(source.data() + source.size()), symbols(symbols) { }
+
+int Lexer::next(YYSTYPE *lval) {
+  const char *p = skipSpaces(current);
+  if (p >= end) {
+    current = end;
+    return 0;
+  }
+
+  const char *start = p;
+  int token;
+  char c = *p;
+
+  if (isIdentStart(c)) {
+    p = skipIdentifier(p + 1);
+    token = keyword(start, p - start);
+    if (token == 0) {
+      current = p;
+      lval->symbol = symbols.intern(llvm::StringRef(start, p - start));
+      return TIDENTIFIER;
+    }
+    current = p;
+    lval->token = token;
+    return token;
+  }
+
+  if (isDigit(c)) {
+    p = skipDigits(p + 1);
+    token = TINTEGER;
+    if (*p == '.') {
+      p = skipDigits(p + 1);
+      token = TDOUBLE;
+    }
+    goto text;
+  }
+
+  switch (c) {
+    case '=':
+      if (p[1] == '=') { p += 2; token = TCEQ; goto simple; }
+      p++; token = TEQUAL; goto simple;
+    case '!':
+      if (p[1] == '=') { p += 2; token = TCNE; goto simple; }
+      break;
+    case '<':
+      if (p[1] == '=') { p += 2; token = TCLE; goto simple; }
+      p++; token = TCLT; goto simple;
+    case '>':
+      if (p[1] == '=') { p += 2; token = TCGE; goto simple; }
+      p++; token = TCGT; goto simple;
+    case '(': p++; token = TLPAREN; goto simple;
+    case ')': p++; token = TRPAREN; goto simple;
+    case '{': p++; token = TLBRACE; goto simple;
+    case '}': p++; token = TRBRACE; goto simple;
+    case '.': p++; token = TDOT; goto simple;
+    case ',': p++; token = TCOMMA; goto simple;
+    case '+': p++; token = TPLUS; goto simple;
+    case '-': p++; token = TMINUS; goto simple;
+    case '*': p++; token = TMUL; goto simple;
+    case '/': p++; token = TDIV; goto simple;
+    case '|': p++; token = TPIPE; goto simple;
+    case ':': p++; token = TCOLON; goto simple;
+    case '#':
+      p = findLineEnd(p + 1, end);
+      token = TCOMMENT_BEG;
+      goto text;
+    case '"': {
+      /* like \".*\": runs to the last quote on the line */
+      const char *lineEnd = findLineEnd(p + 1, end);
+      const char *quote = (const char *)memrchr(p + 1, '"', lineEnd - (p + 1));
+      if (quote != NULL) {
+        p = quote + 1;
+        token = TSTRING;
+        goto text;
+      }
+      break;
+    }
+  }
+
+  printf("Unknown token!\n");
+  current = end;
+  return 0;
+
+simple:
+  current = p;
+  lval->token = token;
+  return token;
+
+text:
+  current = p;
+  lval->text.data = start;
+  lval->text.length = p - start;
+  return token;
+}
+
+TokenSource *createLexer(LexerKind kind, SourceBuffer& source, SymbolTable& symbols) {
+  if (kind == LEXER_FLEX) {
+    return new FlexScanner(source, symbols);
+  }
+  return new Lexer(source, symbols);
+}
+
+unsigned lexerVectorWidth() {
+#ifdef LEXER_VECTOR
+  return LEXER_VECTOR;
+#else
+  return 1;
+#endif
+}
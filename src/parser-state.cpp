@@ -0,0 +1,61 @@
+#include "src/includes/lexer.hpp"
+#include "src/includes/pipelined-lexer.hpp"
+#include "src/includes/descent-parser.hpp"
+#include "src/includes/parser-state.hpp"
+
+int yylex(YYSTYPE *lval, ParserState *state)
+{
+  return state->tokens->next(lval);
+}
+
+void ParserState::beginProgram(NModule *module)
+{
+  topLevelModule = module;
+  programBlock = new (arena) NBlock(arena);
+  if (sink != NULL) {
+    sink->module(*module);
+  }
+  topLevelMark = arena.mark();
+}
+
+/* Everything allocated since the mark belongs to this statement. A
+   function handed to the sink is freed by rolling the arena back, so
+   memory stays bounded by the largest function, not the program. */
+void ParserState::addTopLevel(NStatement *statement)
+{
+  NFunctionDeclaration *function = dynamic_cast<NFunctionDeclaration*>(statement);
+  if (sink != NULL && function != NULL) {
+    sink->function(*function);
+    arena.rollback(topLevelMark);
+    return;
+  }
+  NVariableDeclaration *variable = dynamic_cast<NVariableDeclaration*>(statement);
+  if (sink != NULL && variable != NULL) {
+    sink->variable(*variable);
+  }
+  programBlock->statements.push_back(statement);
+  topLevelMark = arena.mark();
+}
+
+bool parseTokens(TokenSource& tokens, ParserState& state, ParserKind parser)
+{
+  if (parser == PARSER_DESCENT) {
+    DescentParser descent(tokens, state);
+    return descent.parse();
+  }
+  state.tokens = &tokens;
+  int result = yyparse(&state);
+  state.tokens = NULL;
+  return result == 0 && state.programBlock != NULL;
+}
+
+bool parseSource(SourceBuffer& source, ParserState& state, const ParseOptions& options)
+{
+  TokenSource *tokens = createLexer(options.lexer, source, state.symbols);
+  if (source.size() >= options.pipelineThreshold) {
+    tokens = new PipelinedLexer(tokens);
+  }
+  bool parsed = parseTokens(*tokens, state, options.parser);
+  delete tokens;
+  return parsed;
+}
@@ -1,16 +1,30 @@
+%code requires {
+  #include "src/includes/source-buffer.hpp"
+  #include "src/includes/parser-state.hpp"
+}
+
 %{
   #include "src/includes/node.h"
   #include <cstdio>
   #include <cstdlib>
   #define YYERROR_VERBOSE
   #define YYDEBUG 1
-  NBlock *programBlock; /* the top level root node of our final AST */
-  NModule *topLevelModule; /* name of the llvm module */
-
-  extern int yylex();
-  void yyerror(const char *s) { std::printf("Error: %s\n", s);std::exit(1); }
+  /* The stack is on the heap and grows as needed: nested calls and
+     parentheses take one level each, far more than the default 10000 */
+  #define YYMAXDEPTH 100000000
 %}
 
+/* Reentrant: results go to the ParserState, tokens come from the
+   state's token source, nothing lives in globals. */
+%define api.pure
+%parse-param { ParserState *state }
+%lex-param { ParserState *state }
+
+%code {
+  int yylex(YYSTYPE *lvalp, ParserState *state);
+  void yyerror(ParserState *state, const char *s);
+}
+
 /* Represents the many different ways we can access our data */
 %union {
   Node *node;
@@ -20,9 +34,11 @@
   NIdentifier *ident;
   NModule *module;
   NVariableDeclaration *var_decl;
-  std::vector<NVariableDeclaration*> *varvec;
-  std::vector<NExpression*> *exprvec;
-  std::string *string;
+  VariableList *varvec;
+  ExpressionList *exprvec;
+  NMatch *match;
+  SourceSlice text;
+  const Symbol *symbol;
   int token;
 }
 
@@ -30,11 +46,15 @@
    match our tokens.l lex file. We also define the node type
    they represent.
  */
-%token <string> TIDENTIFIER TINTEGER TSTRING TDOUBLE TMODULE TCOMMENT_BEG
+%token <symbol> TIDENTIFIER
+%token <text> TINTEGER TSTRING TDOUBLE TMODULE TCOMMENT_BEG
 %token <token> TCEQ TCNE TCLT TCLE TCGT TCGE TEQUAL TPIPE
 %token <token> TLPAREN TRPAREN TLBRACE TRBRACE TCOMMA TDOT
 %token <token> TPLUS TMINUS TMUL TDIV
 %token <token> TRETURN TFUNC TLET TVISIBILITY
+%token <token> TCOLON
+%token <token> TIF TELSE TWHILE TFOR TFOREACH TIN
+%token <token> TCASE TMATCH TWHEN TTHEN TOTHERWISE
 
 /* Define the type of node our nonterminal symbols represent.
    The types refer to the %union declaration above. Ex: when
@@ -45,12 +65,15 @@
 %type <expr> numeric expr string
 %type <varvec> func_decl_args
 %type <exprvec> call_args
-%type <block> program stmts block
-%type <stmt> stmt var_decl func_decl comment
-%type <token> comparison
+%type <block> stmts block
+%type <stmt> stmt var_decl func_decl comment if_stmt
+%type <var_decl> for_init
+%type <match> case_whens match_whens
+%type <token> comparison type_annotation
 %type <module> module
 
-/* Operator precedence for mathematical operators */
+/* Operator precedence: comparisons bind loosest and do not chain */
+%nonassoc TCEQ TCNE TCLT TCLE TCGT TCGE
 %left TPLUS TMINUS
 %left TMUL TDIV
 
@@ -58,71 +81,128 @@
 
 %%
 
-program : module stmts { topLevelModule = $1; programBlock = $2; }
+program : module top_stmts
         ;
 
-module : TMODULE ident { $$ = new NModule(*$2); }
+module : TMODULE ident { $$ = new (state->arena) NModule(*$2); state->beginProgram($$); }
        ;
 
-stmts : stmt { $$ = new NBlock(); $$->statements.push_back($<stmt>1); }
+/* Top level statements are handed to the state one by one, see
+   ParserState::addTopLevel */
+top_stmts : stmt { state->addTopLevel($1); }
+          | top_stmts stmt { state->addTopLevel($2); }
+          ;
+
+stmts : stmt { $$ = new (state->arena) NBlock(state->arena); $$->statements.push_back($<stmt>1); }
       | stmts stmt { $1->statements.push_back($<stmt>2); }
     ;
 
 stmt : var_decl | func_decl
-     | expr { $$ = new NExpressionStatement(*$1); }
-     | TRETURN expr { $$ = new NReturnStatement(*$2); }
+     | expr { $$ = new (state->arena) NExpressionStatement(*$1); }
+     | TRETURN expr { $$ = new (state->arena) NReturnStatement(*$2); }
      | comment
+     | if_stmt
+     | TWHILE expr block { $$ = new (state->arena) NWhileStatement(*$2, *$3); }
+     | TFOR TLPAREN for_init TCOMMA expr TCOMMA expr TRPAREN block
+       { $$ = new (state->arena) NForStatement(*$3, *$5, *$7, *$9); }
+     | TFOREACH ident TIN ident TLPAREN call_args TRPAREN block
+       { if ($4->name != "range" || $6->size() < 2 || $6->size() > 3) {
+           yyerror(state, "foreach only iterates over range(from, to) or range(from, to, step)"); YYERROR;
+         }
+         $$ = new (state->arena) NForeachStatement(*$2, *(*$6)[0], *(*$6)[1], $6->size() == 3 ? (*$6)[2] : NULL, *$8); }
+     | TCASE TLBRACE case_whens TRBRACE { $$ = new (state->arena) NExpressionStatement(*$3); }
+     | TCASE TLBRACE case_whens TOTHERWISE block TRBRACE
+       { $3->otherwise = $5; $$ = new (state->arena) NExpressionStatement(*$3); }
      ;
 
-comment : TCOMMENT_BEG  { $$ = new NCommentStatement(*$1); }
+/* The whens of a case and of a match, see NMatch */
+case_whens : TWHEN expr block
+             { $$ = new (state->arena) NMatch(state->arena, true);
+               $$->conditions.push_back($2); $$->arms.push_back($3); }
+           | case_whens TWHEN expr block { $1->conditions.push_back($3); $1->arms.push_back($4); }
+           ;
+
+match_whens : TWHEN expr TTHEN expr
+              { $$ = new (state->arena) NMatch(state->arena, false);
+                $$->conditions.push_back($2); $$->arms.push_back($4); }
+            | match_whens TWHEN expr TTHEN expr { $1->conditions.push_back($3); $1->arms.push_back($5); }
+            ;
+
+/* An else if is kept as an else block holding the next if */
+if_stmt : TIF expr block { $$ = new (state->arena) NIfStatement(*$2, *$3); }
+        | TIF expr block TELSE block { $$ = new (state->arena) NIfStatement(*$2, *$3, $5); }
+        | TIF expr block TELSE if_stmt
+          { NBlock *elseBlock = new (state->arena) NBlock(state->arena);
+            elseBlock->statements.push_back($5);
+            $$ = new (state->arena) NIfStatement(*$2, *$3, elseBlock); }
+        ;
+
+for_init : TLET ident type_annotation TEQUAL expr { $$ = new (state->arena) NVariableDeclaration(*$2, $5, (ValueType)$3); }
+         ;
+
+comment : TCOMMENT_BEG  { $$ = new (state->arena) NCommentStatement(state->arena.copyString($1.data, $1.length)); }
         ;
 
 block : TLBRACE stmts TRBRACE { $$ = $2; }
-      | TLBRACE TRBRACE { $$ = new NBlock(); }
+      | TLBRACE TRBRACE { $$ = new (state->arena) NBlock(state->arena); }
     ;
 
-var_decl : TLET ident { $$ = new NVariableDeclaration(*$2); }
-         | TLET ident TEQUAL expr { $$ = new NVariableDeclaration(*$2, $4); }
+var_decl : TLET ident type_annotation { $$ = new (state->arena) NVariableDeclaration(*$2, (ValueType)$3); }
+         | TLET ident type_annotation TEQUAL expr { $$ = new (state->arena) NVariableDeclaration(*$2, $5, (ValueType)$3); }
      ;
 
-func_decl : TFUNC ident TEQUAL TPIPE func_decl_args TPIPE block
-            { $$ = new NFunctionDeclaration(*$2, *$5, *$7);}
-          | TVISIBILITY TFUNC ident TEQUAL TPIPE func_decl_args TPIPE block
-            { $$ = new NFunctionDeclaration(*$3, *$6, *$8, false);}
+func_decl : TFUNC ident TEQUAL TPIPE func_decl_args TPIPE type_annotation block
+            { $$ = new (state->arena) NFunctionDeclaration(*$2, *$5, *$8, true, (ValueType)$7);}
+          | TVISIBILITY TFUNC ident TEQUAL TPIPE func_decl_args TPIPE type_annotation block
+            { $$ = new (state->arena) NFunctionDeclaration(*$3, *$6, *$9, false, (ValueType)$8);}
       ;
 
-func_decl_args : /*blank*/  { $$ = new VariableList(); }
-               | ident { $$ = new VariableList(); $$->push_back(new NVariableDeclaration(*$1)); }
-      | func_decl_args TCOMMA ident { $1->push_back(new NVariableDeclaration(*$3)); }
+func_decl_args : /*blank*/  { $$ = new (state->arena) VariableList(state->arena); }
+               | ident type_annotation { $$ = new (state->arena) VariableList(state->arena); $$->push_back(new (state->arena) NVariableDeclaration(*$1, (ValueType)$2)); }
+      | func_decl_args TCOMMA ident type_annotation { $1->push_back(new (state->arena) NVariableDeclaration(*$3, (ValueType)$4)); }
       ;
 
-ident : TIDENTIFIER { $$ = new NIdentifier(*$1); delete $1; }
+/* Optional `: type` after a let, an argument or the arguments of a
+   function, see typeNamed */
+type_annotation : /*blank*/ { $$ = TYPE_UNKNOWN; }
+                | TCOLON TIDENTIFIER
+                  { $$ = typeNamed($2->name);
+                    if ($$ == TYPE_UNKNOWN) { yyerror(state, "unknown type in annotation"); YYERROR; } }
       ;
 
-numeric : TINTEGER { $$ = new NInteger(atol($1->c_str())); delete $1; }
-        | TDOUBLE { $$ = new NDouble(atof($1->c_str())); delete $1; }
+ident : TIDENTIFIER { $$ = new (state->arena) NIdentifier($1); }
+      ;
+
+numeric : TINTEGER { $$ = new (state->arena) NInteger(sliceToInteger($1)); }
+        | TDOUBLE { $$ = new (state->arena) NDouble(sliceToDouble($1)); }
     ;
 
-string : TSTRING { std::string foo = "BLAH "; $$ = new NString(foo);}
+string : TSTRING { $$ = new (state->arena) NString("BLAH "); }
        ;
 
-expr : ident TEQUAL expr { $$ = new NAssignment(*$<ident>1, *$3); }
-     | ident TLPAREN call_args TRPAREN { $$ = new NMethodCall(*$1, *$3); }
+expr : ident TEQUAL expr { $$ = new (state->arena) NAssignment(*$<ident>1, *$3); }
+     | ident TLPAREN call_args TRPAREN { $$ = new (state->arena) NMethodCall(*$1, *$3); }
      | ident { $<ident>$ = $1; }
      | string
      | numeric
-     | expr TMUL expr { $$ = new NBinaryOperator(*$1, $2, *$3); }
-     | expr TDIV expr { $$ = new NBinaryOperator(*$1, $2, *$3); }
-     | expr TPLUS expr { $$ = new NBinaryOperator(*$1, $2, *$3); }
-     | expr TMINUS expr { $$ = new NBinaryOperator(*$1, $2, *$3); }
-     | expr comparison expr { $$ = new NBinaryOperator(*$1, $2, *$3); }
+     | expr TMUL expr { $$ = new (state->arena) NBinaryOperator(*$1, $2, *$3); }
+     | expr TDIV expr { $$ = new (state->arena) NBinaryOperator(*$1, $2, *$3); }
+     | expr TPLUS expr { $$ = new (state->arena) NBinaryOperator(*$1, $2, *$3); }
+     | expr TMINUS expr { $$ = new (state->arena) NBinaryOperator(*$1, $2, *$3); }
+     | expr comparison expr %prec TCEQ { $$ = new (state->arena) NBinaryOperator(*$1, $2, *$3); }
      | TLPAREN expr TRPAREN { $$ = $2; }
+     | TMATCH TLBRACE match_whens TOTHERWISE expr TRBRACE { $3->otherwise = $5; $$ = $3; }
    ;
 
-call_args : /*blank*/  { $$ = new ExpressionList(); }
-          | expr { $$ = new ExpressionList(); $$->push_back($1); }
+call_args : /*blank*/  { $$ = new (state->arena) ExpressionList(state->arena); }
+          | expr { $$ = new (state->arena) ExpressionList(state->arena); $$->push_back($1); }
       | call_args TCOMMA expr  { $1->push_back($3); }
       ;
 
 comparison : TCEQ | TCNE | TCLT | TCLE | TCGT | TCGE;
 %%
+
+void yyerror(ParserState *state, const char *s)
+{
+  state->error = s;
+}
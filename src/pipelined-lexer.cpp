@@ -0,0 +1,72 @@
+#include <sched.h>
+#include "src/includes/pipelined-lexer.hpp"
+
+PipelinedLexer::PipelinedLexer(TokenSource *lexer) :
+  lexer(lexer), ring(new Token[CAPACITY]), stopped(0)
+{
+  producer.head = producer.tail = 0;
+  consumer.head = consumer.tail = 0;
+  threaded = pthread_create(&thread, NULL, run, this) == 0;
+}
+
+PipelinedLexer::~PipelinedLexer()
+{
+  if (threaded) {
+    __atomic_store_n(&stopped, 1, __ATOMIC_RELEASE);
+    pthread_join(thread, NULL);
+  }
+  delete lexer;
+  delete[] ring;
+}
+
+void *PipelinedLexer::run(void *self)
+{
+  static_cast<PipelinedLexer *>(self)->produce();
+  return NULL;
+}
+
+/* Lexer thread: fills slots until the end of the input, token 0 */
+void PipelinedLexer::produce()
+{
+  unsigned head = producer.head;
+  for (;;) {
+    while (head - producer.tail == CAPACITY) {
+      if (__atomic_load_n(&stopped, __ATOMIC_ACQUIRE)) {
+        return;
+      }
+      producer.tail = __atomic_load_n(&consumer.tail, __ATOMIC_ACQUIRE);
+      if (head - producer.tail == CAPACITY) {
+        sched_yield();
+      }
+    }
+    Token& slot = ring[head & (CAPACITY - 1)];
+    slot.token = lexer->next(&slot.value);
+    head++;
+    __atomic_store_n(&producer.head, head, __ATOMIC_RELEASE);
+    if (slot.token == 0) {
+      return;
+    }
+  }
+}
+
+/* Parser thread. The end of the input is left in the ring, so asking
+   again after it keeps returning 0. */
+int PipelinedLexer::next(YYSTYPE *lval)
+{
+  if (!threaded) {
+    return lexer->next(lval);
+  }
+  unsigned tail = consumer.tail;
+  while (tail == consumer.head) {
+    consumer.head = __atomic_load_n(&producer.head, __ATOMIC_ACQUIRE);
+    if (tail == consumer.head) {
+      sched_yield();
+    }
+  }
+  const Token& slot = ring[tail & (CAPACITY - 1)];
+  *lval = slot.value;
+  if (slot.token != 0) {
+    __atomic_store_n(&consumer.tail, tail + 1, __ATOMIC_RELEASE);
+  }
+  return slot.token;
+}
@@ -0,0 +1,47 @@
+#include "src/includes/resolver.hpp"
+#include "src/includes/codegen.hpp"
+
+void FunctionResolver::resolve(NBlock& root)
+{
+  forward = false;
+  declaring = true;
+  root.accept(*this);
+  declaring = false;
+  root.accept(*this);
+}
+
+void FunctionResolver::resolve(NFunctionDeclaration& function)
+{
+  forward = true;
+  declaring = true;
+  function.accept(*this);
+  declaring = false;
+  function.accept(*this);
+}
+
+void FunctionResolver::visit(NFunctionDeclaration& node)
+{
+  if (declaring) {
+    std::vector<ValueType> argumentTypes;
+    VariableList::const_iterator it;
+    for (it = node.arguments.begin(); it != node.arguments.end(); it++) {
+      argumentTypes.push_back((**it).annotation != TYPE_UNKNOWN ? (**it).annotation : TYPE_DYNAMIC);
+    }
+    context.declareFunction(node.id.symbol, argumentTypes, node.returnAnnotation, node.externalLinkage);
+  }
+  AstVisitor::visit(node);
+}
+
+void FunctionResolver::enter(NMethodCall& node)
+{
+  if (!declaring) {
+    Function *callee = forward ? context.callFunction(node.id.symbol, node.arguments.size())
+                               : context.lookupFunction(node.id.symbol);
+    if (callee->arg_size() != node.arguments.size()) {
+      std::cerr << "[ERR]" << node.id.name.str() << " takes " << callee->arg_size()
+                << " argument(s), not " << node.arguments.size() << std::endl;
+      exit(-1);
+    }
+    node.callee = callee;
+  }
+}
@@ -0,0 +1,60 @@
+#include "src/includes/scope-table.hpp"
+
+const unsigned ScopeTable::NONE;
+
+void ScopeTable::pushFunction()
+{
+  Scope scope;
+  scope.first = scope.visible = entries.size();
+  scopes.push_back(scope);
+}
+
+void ScopeTable::pushScope()
+{
+  Scope scope;
+  scope.first = entries.size();
+  scope.visible = scopes.empty() ? 0 : scopes.back().visible;
+  scopes.push_back(scope);
+}
+
+void ScopeTable::pop()
+{
+  unsigned first = scopes.back().first;
+  while (entries.size() > first) {
+    const Entry& entry = entries.back();
+    innermost[entry.symbol->id] = entry.shadowed;
+    entries.pop_back();
+  }
+  scopes.pop_back();
+}
+
+llvm::Value *ScopeTable::lookup(const Symbol *symbol) const
+{
+  if (symbol->id >= innermost.size()) {
+    return NULL;
+  }
+  /* Anything older than the innermost binding is further out still */
+  unsigned index = innermost[symbol->id];
+  if (index == NONE || index < scopes.back().visible) {
+    return NULL;
+  }
+  return entries[index].value;
+}
+
+void ScopeTable::bind(const Symbol *symbol, llvm::Value *value)
+{
+  if (symbol->id >= innermost.size()) {
+    innermost.resize(symbol->id + 1, NONE);
+  }
+  unsigned index = innermost[symbol->id];
+  if (index != NONE && index >= scopes.back().first) {
+    entries[index].value = value;
+    return;
+  }
+  Entry entry;
+  entry.symbol = symbol;
+  entry.value = value;
+  entry.shadowed = index;
+  innermost[symbol->id] = entries.size();
+  entries.push_back(entry);
+}
@@ -0,0 +1,119 @@
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "src/includes/source-buffer.hpp"
+
+long long sliceToInteger(const SourceSlice& slice)
+{
+  long long value = 0;
+  for (size_t i = 0; i < slice.length; i++) {
+    value = value * 10 + (slice.data[i] - '0');
+  }
+  return value;
+}
+
+double sliceToDouble(const SourceSlice& slice)
+{
+  /* strtod wants a terminated string, and the slice is not one */
+  char local[64];
+  if (slice.length < sizeof(local)) {
+    memcpy(local, slice.data, slice.length);
+    local[slice.length] = '\0';
+    return strtod(local, NULL);
+  }
+  return strtod(slice.str().c_str(), NULL);
+}
+
+SourceBuffer::SourceBuffer() : base(NULL), length(0), capacity(0), mapped(false) { }
+
+SourceBuffer::~SourceBuffer() {
+  release();
+}
+
+void SourceBuffer::release() {
+  if (base != NULL && mapped) {
+    munmap(base, capacity);
+  } else if (base != NULL) {
+    free(base);
+  }
+  base = NULL;
+  length = capacity = 0;
+  mapped = false;
+}
+
+bool SourceBuffer::open(const char *fileName) {
+  int fd = ::open(fileName, O_RDONLY);
+  if (fd < 0) {
+    return false;
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+    FILE *stream = fdopen(fd, "r");
+    bool ok = stream != NULL && read(stream);
+    if (stream != NULL) {
+      fclose(stream);
+    } else {
+      close(fd);
+    }
+    return ok;
+  }
+
+  release();
+  size_t page = sysconf(_SC_PAGESIZE);
+  length = st.st_size;
+  capacity = (length + SOURCE_PADDING + page - 1) / page * page;
+
+  /* Reserve zeroed memory for the text plus its padding, then map the
+     file over the front of it. Whatever follows the end of the file is
+     still zero, even when the file fills its last page exactly.
+     The mapping is private and writable because flex temporarily
+     NUL-terminates yytext in place; only the pages it touches get copied. */
+  void *region = mmap(NULL, capacity, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (region == MAP_FAILED) {
+    close(fd);
+    length = capacity = 0;
+    return false;
+  }
+  if (length > 0 &&
+      mmap(region, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, fd, 0) == MAP_FAILED) {
+    munmap(region, capacity);
+    close(fd);
+    length = capacity = 0;
+    return false;
+  }
+  close(fd);
+
+  base = (char *)region;
+  mapped = true;
+  madvise(base, capacity, MADV_SEQUENTIAL);
+  return true;
+}
+
+bool SourceBuffer::read(FILE *stream) {
+  release();
+  capacity = 64 * 1024;
+  base = (char *)malloc(capacity);
+
+  size_t count;
+  while (base != NULL && (count = fread(base + length, 1, capacity - length - SOURCE_PADDING, stream)) > 0) {
+    length += count;
+    if (capacity - length - SOURCE_PADDING == 0) {
+      capacity *= 2;
+      char *grown = (char *)realloc(base, capacity);
+      if (grown == NULL) {
+        free(base);
+      }
+      base = grown;
+    }
+  }
+  if (base == NULL || ferror(stream)) {
+    release();
+    return false;
+  }
+  memset(base + length, 0, SOURCE_PADDING);
+  return true;
+}
@@ -0,0 +1,145 @@
+#include <vector>
+#include "src/includes/streaming-codegen.hpp"
+#include "src/includes/node.h"
+#include "src/includes/resolver.hpp"
+
+void createCoreFunctions(CodeGenContext& context);
+
+/* The context is made here, before the parse, as creating it and the
+   core functions interns names: the pipelined lexer interns into the
+   same table from its own thread once the parse has started. The
+   module gets its name when the parser reaches it. */
+StreamingCodeGen::StreamingCodeGen(SymbolTable& symbols, Arena& arena, AstPassManager& passes,
+                                   const char *outputFileName, const CodeGenOptions& options) :
+  context(new CodeGenContext("", symbols, options)), symbols(symbols), arena(arena), passes(passes),
+  options(options), scratch(new Module("streaming", getGlobalContext()))
+{
+  file = fopen(outputFileName, "w+");
+  out = new raw_fd_ostream(fileno(file), true, false);
+  createCoreFunctions(*context);
+  /* What is already there is written with the rest of the module */
+  for (Module::iterator it = context->module->begin(); it != context->module->end(); it++) {
+    kept.insert(&*it);
+  }
+}
+
+StreamingCodeGen::~StreamingCodeGen()
+{
+  delete out;
+  delete scratch;
+  delete context;
+}
+
+void StreamingCodeGen::module(NModule& module)
+{
+  context->module->setModuleIdentifier(module.ident.name.str());
+  *out << "; ModuleID = '" << context->module->getModuleIdentifier() << "'\n";
+}
+
+/* New functions, the declaration's and any nested in it, are the ones
+   after the last function already seen, apart from the prototypes of
+   functions called but not defined yet. Once written, a function is
+   only kept as a declaration for the calls to it, until retire drops
+   it. */
+void StreamingCodeGen::function(NFunctionDeclaration& declaration)
+{
+  passes.run(declaration, arena);
+  FunctionResolver resolver(*context);
+  resolver.resolve(declaration);
+  declaration.codeGen(*context, 0);
+
+  std::vector<Function*> created;
+  for (Module::reverse_iterator it = context->module->rbegin(); it != context->module->rend(); it++) {
+    Function *function = &*it;
+    if (written.count(function) || kept.count(function)) {
+      break;
+    }
+    if (!function->isDeclaration()) {
+      created.push_back(function);
+    }
+  }
+  for (size_t i = created.size(); i-- > 0; ) {
+    Function *function = created[i];
+    verifyFunction(*function);
+    context->optimizeFunction(*function);
+    write(function);
+    function->deleteBody();
+    written.insert(function);
+  }
+  retire();
+}
+
+/* A written function nothing calls any more leaves the module, and is
+   declared again by the next function that calls it. So the module
+   only holds the prototypes the functions not written yet refer to,
+   not one for every function of the program. */
+void StreamingCodeGen::retire()
+{
+  std::vector<const Symbol*> unused;
+  DenseMap<const Symbol*, Function*>::iterator it;
+  for (it = context->functions.begin(); it != context->functions.end(); it++) {
+    Function *function = it->second;
+    if (function->use_empty() && (written.count(function) || context->isRetired(it->first))) {
+      unused.push_back(it->first);
+    }
+  }
+  for (size_t i = 0; i < unused.size(); i++) {
+    written.erase(context->functions.lookup(unused[i]));
+    context->retireFunction(unused[i]);
+  }
+}
+
+/* The passes learn of the constant first, as they may fold its value */
+void StreamingCodeGen::variable(NVariableDeclaration& declaration)
+{
+  passes.declare(declaration, arena);
+  if (declaration.hasLiteralValue()) {
+    context->declareConstant(declaration.id.symbol, declaration.annotation,
+                             cast<Constant>(declaration.assignmentExpr->codeGen(*context, 0)));
+  }
+}
+
+/* Printing a function numbers the globals and collects the types of
+   the whole module it is in, which would make streaming quadratic in
+   the number of functions. So it is printed from a module of its own.
+   Everything it refers to is named, and so prints the same. */
+void StreamingCodeGen::write(Function *function)
+{
+  Module *module = function->getParent();
+  function->removeFromParent();
+  scratch->getFunctionList().push_back(function);
+  *out << "\n";
+  function->print(*out);
+  function->removeFromParent();
+  module->getFunctionList().push_back(function);
+}
+
+void StreamingCodeGen::finish(NModule& module, NBlock& root)
+{
+  passes.run(root, arena);
+  context->generateCode(module, root);
+
+  /* The prototypes of the functions written out, declared again for
+     the entry point, must not follow their definitions */
+  SmallPtrSet<Function*, 16> declared;
+  DenseMap<const Symbol*, Function*>::iterator fn;
+  for (fn = context->functions.begin(); fn != context->functions.end(); fn++) {
+    if (context->isRetired(fn->first)) {
+      declared.insert(fn->second);
+    }
+  }
+
+  Module *llvmModule = context->module;
+  *out << "\n";
+  for (Module::global_iterator it = llvmModule->global_begin(); it != llvmModule->global_end(); it++) {
+    it->print(*out);
+    *out << "\n";
+  }
+  for (Module::iterator it = llvmModule->begin(); it != llvmModule->end(); it++) {
+    if (!written.count(&*it) && !declared.count(&*it)) {
+      *out << "\n";
+      it->print(*out);
+    }
+  }
+  out->flush();
+}
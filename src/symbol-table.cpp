@@ -0,0 +1,13 @@
+#include "src/includes/symbol-table.hpp"
+
+const Symbol *SymbolTable::intern(llvm::StringRef name)
+{
+  Symbol *&slot = table[name];
+  if (slot == NULL) {
+    slot = new (storage) Symbol();
+    slot->name = storage.copyString(name.data(), name.size());
+    slot->id = symbols.size();
+    symbols.push_back(slot);
+  }
+  return slot;
+}
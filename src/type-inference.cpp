@@ -0,0 +1,285 @@
+#include "src/includes/type-inference.hpp"
+#include "build/parser.hpp"
+
+/* Records the result type each function is annotated with */
+class ResultCollector : public AstVisitor {
+  public:
+    ResultCollector(llvm::DenseMap<const Symbol*, ValueType>& results) : results(results) { }
+
+    virtual void visit(NFunctionDeclaration& node) {
+      if (node.returnAnnotation != TYPE_UNKNOWN) {
+        results[node.id.symbol] = node.returnAnnotation;
+      }
+      AstVisitor::visit(node);
+    }
+    using AstVisitor::visit;
+
+  private:
+    llvm::DenseMap<const Symbol*, ValueType>& results;
+};
+
+void TypeInference::run(NBlock& root, Arena& arena)
+{
+  for (size_t i = 0; i < root.statements.size(); i++) {
+    if (NVariableDeclaration *declaration = dynamic_cast<NVariableDeclaration*>(root.statements[i])) {
+      declare(*declaration, arena);
+    }
+  }
+  ResultCollector collector(results);
+  root.accept(collector);
+  inferFunction(root, NULL);
+}
+
+void TypeInference::run(NFunctionDeclaration& function, Arena& arena)
+{
+  ResultCollector collector(results);
+  function.accept(collector);
+  inferFunction(function.block, &function.arguments);
+}
+
+/* A later let of the same name replaces the constant, as it does the
+   value of a local */
+void TypeInference::declare(NVariableDeclaration& declaration, Arena& arena)
+{
+  if (!declaration.hasLiteralValue()) {
+    constants.erase(declaration.id.symbol);
+    return;
+  }
+  constants[declaration.id.symbol] = declaration.annotation != TYPE_UNKNOWN
+      ? declaration.annotation : declaration.assignmentExpr->type;
+}
+
+void TypeInference::report(std::ostream& out) const
+{
+  out << ", " << integers << " integer, " << floats << " floating point and "
+      << dynamics << " dynamic local(s)";
+}
+
+static bool isInteger(ValueType type)
+{
+  return type == TYPE_INT || type == TYPE_I8 || type == TYPE_I16 || type == TYPE_I32 || type == TYPE_BOOL;
+}
+
+static bool isFloat(ValueType type)
+{
+  return type == TYPE_DOUBLE || type == TYPE_F32;
+}
+
+static bool isComparison(int op)
+{
+  return op == TCEQ || op == TCNE || op == TCLT || op == TCLE || op == TCGT || op == TCGE;
+}
+
+/* Bits of an integer type in arithmetic, where a bool counts as an i8 */
+static unsigned widthOf(ValueType type)
+{
+  switch (type) {
+    case TYPE_BOOL:
+    case TYPE_I8:  return 8;
+    case TYPE_I16: return 16;
+    case TYPE_I32: return 32;
+    default:       return 64;
+  }
+}
+
+/* Whether a literal keeps its value in a signed integer of the width */
+static bool fitsIn(long long value, unsigned width)
+{
+  if (width >= 64) {
+    return true;
+  }
+  long long limit = 1LL << (width - 1);
+  return value >= -limit && value < limit;
+}
+
+/* Unknown, the type of no value, is below every other type, which are
+   all below dynamic. Numbers of which one is floating point join as a
+   double: dynamic is held in an integer, which would truncate them. */
+static ValueType join(ValueType a, ValueType b)
+{
+  if (a == TYPE_UNKNOWN || a == b) {
+    return b;
+  }
+  if (b == TYPE_UNKNOWN) {
+    return a;
+  }
+  if ((isFloat(a) || isFloat(b)) && (isFloat(a) || isInteger(a)) && (isFloat(b) || isInteger(b))) {
+    return TYPE_DOUBLE;
+  }
+  return TYPE_DYNAMIC;
+}
+
+/* Inferred types only go up, and an annotation only counts as a change
+   the first time a local gets one, so the walks stop after a few
+   changes per local. A name annotated again, as by a later let or
+   a foreach, has the new type from there on in each walk. Nested
+   functions have locals of their own and are inferred once the
+   enclosing one is done. */
+void TypeInference::inferFunction(NBlock& body, const VariableList *arguments)
+{
+  LocalMap *enclosingLocals = locals;
+  std::vector<NFunctionDeclaration*> *enclosingNested = nested;
+  LocalMap functionLocals;
+  std::vector<NFunctionDeclaration*> functionNested;
+  locals = &functionLocals;
+  nested = &functionNested;
+
+  if (arguments != NULL) {
+    VariableList::const_iterator it;
+    for (it = arguments->begin(); it != arguments->end(); it++) {
+      ValueType type = (**it).annotation != TYPE_UNKNOWN ? (**it).annotation : TYPE_DYNAMIC;
+      annotate((**it).id.symbol, type);
+      (**it).id.type = type;
+    }
+  }
+  do {
+    changed = false;
+    functionNested.clear();
+    body.accept(*this);
+  } while (changed);
+
+  LocalMap::const_iterator it;
+  for (it = functionLocals.begin(); it != functionLocals.end(); it++) {
+    if (isInteger(it->second.type)) {
+      integers++;
+    } else if (isFloat(it->second.type)) {
+      floats++;
+    } else {
+      dynamics++;
+    }
+  }
+  for (size_t i = 0; i < functionNested.size(); i++) {
+    inferFunction(functionNested[i]->block, &functionNested[i]->arguments);
+  }
+
+  locals = enclosingLocals;
+  nested = enclosingNested;
+}
+
+void TypeInference::assign(const Symbol *symbol, ValueType type)
+{
+  LocalMap::iterator it = locals->find(symbol);
+  if (it == locals->end()) {
+    Local local = { type, false };
+    (*locals)[symbol] = local;
+    changed = changed || type != TYPE_UNKNOWN;
+    return;
+  }
+  if (it->second.annotated) {
+    return;
+  }
+  ValueType joined = join(it->second.type, type);
+  if (joined != it->second.type) {
+    it->second.type = joined;
+    changed = true;
+  }
+}
+
+void TypeInference::annotate(const Symbol *symbol, ValueType type)
+{
+  Local& local = (*locals)[symbol];
+  if (!local.annotated) {
+    changed = true;
+  }
+  local.type = type;
+  local.annotated = true;
+}
+
+NExpression *TypeInference::visit(NIdentifier& node)
+{
+  LocalMap::const_iterator it = locals->find(node.symbol);
+  if (it != locals->end()) {
+    node.type = it->second.type;
+    return &node;
+  }
+  llvm::DenseMap<const Symbol*, ValueType>::const_iterator constant = constants.find(node.symbol);
+  node.type = constant != constants.end() ? constant->second : TYPE_UNKNOWN;
+  return &node;
+}
+
+NExpression *TypeInference::leave(NMethodCall& node)
+{
+  llvm::DenseMap<const Symbol*, ValueType>::const_iterator it = results.find(node.id.symbol);
+  node.type = it != results.end() ? it->second : TYPE_DYNAMIC;
+  return &node;
+}
+
+/* The operand of the narrower type is converted to the other's; a
+   comparison is a bool whatever it compares. An integer literal has no
+   width of its own next to a typed integer: x + 1 on an i16 x is an
+   i16, as long as the literal fits in one. Two literals make an i64. */
+NExpression *TypeInference::leave(NBinaryOperator& node)
+{
+  ValueType left = node.lhs->type, right = node.rhs->type;
+  if (isComparison(node.op)) {
+    node.type = TYPE_BOOL;
+  } else if (isFloat(left) || isFloat(right)) {
+    node.type = left == TYPE_DOUBLE || right == TYPE_DOUBLE ? TYPE_DOUBLE : TYPE_F32;
+  } else if (isInteger(left) && isInteger(right)) {
+    NInteger *leftLiteral = dynamic_cast<NInteger*>(node.lhs);
+    NInteger *rightLiteral = dynamic_cast<NInteger*>(node.rhs);
+    unsigned leftWidth = widthOf(left), rightWidth = widthOf(right);
+    if (leftLiteral != NULL && rightLiteral == NULL && fitsIn(leftLiteral->value, rightWidth)) {
+      leftWidth = rightWidth;
+    } else if (rightLiteral != NULL && leftLiteral == NULL && fitsIn(rightLiteral->value, leftWidth)) {
+      rightWidth = leftWidth;
+    }
+    unsigned width = std::max(leftWidth, rightWidth);
+    node.type = width == 8 ? TYPE_I8 : width == 16 ? TYPE_I16 : width == 32 ? TYPE_I32 : TYPE_INT;
+  } else if (left == TYPE_UNKNOWN || right == TYPE_UNKNOWN) {
+    node.type = TYPE_UNKNOWN;
+  } else {
+    node.type = TYPE_DYNAMIC;
+  }
+  return &node;
+}
+
+NExpression *TypeInference::leave(NAssignment& node)
+{
+  assign(node.lhs.symbol, node.rhs->type);
+  node.type = node.rhs->type;
+  return &node;
+}
+
+/* A match has the type all its arms agree on, as a local has that of
+   the values assigned to it; a case has no value */
+NExpression *TypeInference::visit(NMatch& node)
+{
+  AstVisitor::visit(node);
+  if (node.isCase) {
+    node.type = TYPE_DYNAMIC;
+    return &node;
+  }
+  ValueType type = node.otherwise->type;
+  for (size_t i = 0; i < node.arms.size(); i++) {
+    type = join(type, node.arms[i]->type);
+  }
+  node.type = type;
+  return &node;
+}
+
+/* An annotated let has its type from the start of the function on,
+   which is only set on the first walk */
+void TypeInference::visit(NVariableDeclaration& node)
+{
+  AstVisitor::visit(node);
+  if (node.annotation != TYPE_UNKNOWN) {
+    annotate(node.id.symbol, node.annotation);
+  } else {
+    assign(node.id.symbol, node.assignmentExpr != NULL ? node.assignmentExpr->type : TYPE_UNKNOWN);
+  }
+  node.id.type = (*locals)[node.id.symbol].type;
+}
+
+/* The counter of a foreach is an i64, whatever the range is given */
+void TypeInference::visit(NForeachStatement& node)
+{
+  annotate(node.id.symbol, TYPE_INT);
+  node.id.type = TYPE_INT;
+  AstVisitor::visit(node);
+}
+
+void TypeInference::visit(NFunctionDeclaration& node)
+{
+  nested->push_back(&node);
+}
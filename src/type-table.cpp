@@ -0,0 +1,22 @@
+#include <llvm/DerivedTypes.h>
+#include "src/includes/type-table.hpp"
+
+/* Dynamic values are held in an i64 until there is a boxed
+   representation for them */
+TypeTable::TypeTable(llvm::LLVMContext& context)
+{
+  struct { ValueType kind; llvm::Type *llvmType; } types[] = {
+    { TYPE_DYNAMIC, llvm::Type::getInt64Ty(context) },
+    { TYPE_INT,     llvm::Type::getInt64Ty(context) },
+    { TYPE_DOUBLE,  llvm::Type::getDoubleTy(context) },
+    { TYPE_UNKNOWN, llvm::Type::getInt64Ty(context) },
+    { TYPE_I8,      llvm::Type::getInt8Ty(context) },
+    { TYPE_I16,     llvm::Type::getInt16Ty(context) },
+    { TYPE_I32,     llvm::Type::getInt32Ty(context) },
+    { TYPE_F32,     llvm::Type::getFloatTy(context) },
+    { TYPE_BOOL,    llvm::Type::getInt1Ty(context) },
+  };
+  for (unsigned i = 0; i < TYPE_COUNT; i++) {
+    descriptors[types[i].kind].llvmType = types[i].llvmType;
+  }
+}